@@ -23,4 +23,12 @@ for image in files:
 	head, tail = os.path.split(image)
 	run_opt('grey', tail)
 	run_opt('blur', tail)
-	run_opt('hsv', tail)
\ No newline at end of file
+	run_opt('hsv', tail)
+
+print('Running batch tests...')
+
+for opt in ['grey', 'blur', 'hsv']:
+	print('+++ BATCH WITHOUT CUDA +++')
+	os.system('bin/image_modifier_no_parallism --batch %s examples export/batch_%s' % (opt, opt))
+	print('+++ BATCH CUDA +++')
+	os.system('bin/image_modifier_cuda --batch %s examples export/batch_%s' % (opt, opt))
\ No newline at end of file
@@ -0,0 +1,9 @@
+#!/bin/bash
+
+make threaded_lodepng
+mkdir -p export/
+
+bin/image_modifier_threaded grey examples/example_image1_small.png export/example_image1_small_grey.png
+bin/image_modifier_threaded emboss examples/example_image1_small.png export/example_image1_small_emboss.png
+bin/image_modifier_threaded blur examples/example_image1_small.png export/example_image1_small_blur.png
+bin/image_modifier_threaded hsv examples/example_image1_small.png export/example_image1_small_hsv.png
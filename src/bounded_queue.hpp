@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * A queue with a fixed capacity which connects two pipeline stages.
+ * Producers block while the queue is full, so a fast stage can not
+ * run ahead and fill the memory with images.
+ */
+template<typename T>
+class bounded_queue
+{
+public:
+	explicit bounded_queue(uint32_t capacity)
+		: capacity(capacity > 0 ? capacity : 1)
+	{
+	}
+
+	/*
+	 * Appends the item and blocks while the queue is full.
+	 * Returns false if the queue was closed.
+	 */
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+
+		if(closed)
+			return false;
+
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+
+		return true;
+	}
+
+	/*
+	 * Removes the first item and blocks while the queue is empty.
+	 * Returns false if the queue is closed and empty.
+	 */
+	bool pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this] { return closed || !items.empty(); });
+
+		if(items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+
+		return true;
+	}
+
+	/*
+	 * Wakes up all waiting threads. Remaining items can still be popped.
+	 */
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+
+private:
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	uint32_t capacity;
+	bool closed = false;
+};
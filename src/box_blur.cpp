@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "shared.hpp"
+#include "box_blur.hpp"
+
+using namespace std;
+
+/*
+ * Multiplier which divides by count with a multiplication and a shift.
+ * The sums of a box are below 256 * count and count is at most
+ * 2 * BOX_BLUR_MAX_RADIUS + 1 < 2^12, so the quotient is exact.
+ */
+static inline uint64_t box_divisor(uint32_t count)
+{
+	return ((uint64_t)1 << 32) / count + 1;
+}
+
+/* Returns the rounded quotient of the sum and the count of the divisor. */
+static inline uint32_t box_mean(uint32_t sum, uint32_t count, uint64_t divisor)
+{
+	return (uint32_t)(((uint64_t)(sum + count / 2) * divisor) >> 32);
+}
+
+void kernel_box_horizontal(uint32_t width, uint32_t /*height*/, uint32_t radius, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	const int32_t size = (int32_t)width;
+	const int32_t r = (int32_t)radius;
+
+	for(uint32_t row = row_begin; row < row_end; ++row)
+	{
+		const uint32_t *src = in + (size_t)row * width;
+		uint32_t *dst = out + (size_t)row * width;
+
+		uint32_t red = 0, green = 0, blue = 0, alpha = 0;
+
+		for(int32_t col = 0; col < min(r, size - 1) + 1; ++col)
+		{
+			red += RED8(src[col]);
+			green += GREEN8(src[col]);
+			blue += BLUE8(src[col]);
+			alpha += ALPHA8(src[col]);
+		}
+
+		uint32_t count = 0;
+		uint64_t divisor = 0;
+
+		for(int32_t col = 0; col < size; ++col)
+		{
+			uint32_t box = (uint32_t)(min(col + r, size - 1) - max(col - r, 0) + 1);
+
+			/* The count only changes within the radius of the row ends. */
+			if(box != count)
+			{
+				count = box;
+				divisor = box_divisor(count);
+			}
+
+			dst[col] = RGBA32(box_mean(red, count, divisor), box_mean(green, count, divisor), box_mean(blue, count, divisor), box_mean(alpha, count, divisor));
+
+			if(col + r + 1 < size)
+			{
+				uint32_t pixel = src[col + r + 1];
+
+				red += RED8(pixel);
+				green += GREEN8(pixel);
+				blue += BLUE8(pixel);
+				alpha += ALPHA8(pixel);
+			}
+
+			if(col - r >= 0)
+			{
+				uint32_t pixel = src[col - r];
+
+				red -= RED8(pixel);
+				green -= GREEN8(pixel);
+				blue -= BLUE8(pixel);
+				alpha -= ALPHA8(pixel);
+			}
+		}
+	}
+}
+
+/* Adds the channels of the strip of a row to the sums, sign is 1 or -1. */
+static inline void box_accumulate(const uint32_t *row, uint32_t count, uint32_t sign, uint32_t *red, uint32_t *green, uint32_t *blue, uint32_t *alpha)
+{
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		red[i] += sign * RED8(row[i]);
+		green[i] += sign * GREEN8(row[i]);
+		blue[i] += sign * BLUE8(row[i]);
+		alpha[i] += sign * ALPHA8(row[i]);
+	}
+}
+
+void kernel_box_vertical(uint32_t width, uint32_t height, uint32_t radius, const uint32_t *in, uint32_t *out, uint32_t col_begin, uint32_t col_end)
+{
+	const int32_t size = (int32_t)height;
+	const int32_t r = (int32_t)radius;
+
+	for(uint32_t strip = col_begin; strip < col_end; strip += BOX_BLUR_STRIP)
+	{
+		const uint32_t columns = min(strip + BOX_BLUR_STRIP, col_end) - strip;
+
+		/* One running sum per channel and column, the loops over them are vectorized. */
+		uint32_t red[BOX_BLUR_STRIP], green[BOX_BLUR_STRIP], blue[BOX_BLUR_STRIP], alpha[BOX_BLUR_STRIP];
+
+		memset(red, 0, sizeof(red));
+		memset(green, 0, sizeof(green));
+		memset(blue, 0, sizeof(blue));
+		memset(alpha, 0, sizeof(alpha));
+
+		for(int32_t row = 0; row < min(r, size - 1) + 1; ++row)
+			box_accumulate(in + (size_t)row * width + strip, columns, 1, red, green, blue, alpha);
+
+		uint32_t count = 0;
+		uint64_t divisor = 0;
+
+		for(int32_t row = 0; row < size; ++row)
+		{
+			uint32_t box = (uint32_t)(min(row + r, size - 1) - max(row - r, 0) + 1);
+
+			if(box != count)
+			{
+				count = box;
+				divisor = box_divisor(count);
+			}
+
+			uint32_t *dst = out + (size_t)row * width + strip;
+
+			for(uint32_t i = 0; i < columns; ++i)
+				dst[i] = RGBA32(box_mean(red[i], count, divisor), box_mean(green[i], count, divisor), box_mean(blue[i], count, divisor), box_mean(alpha[i], count, divisor));
+
+			if(row + r + 1 < size)
+				box_accumulate(in + (size_t)(row + r + 1) * width + strip, columns, 1, red, green, blue, alpha);
+
+			if(row - r >= 0)
+				box_accumulate(in + (size_t)(row - r) * width + strip, columns, (uint32_t)-1, red, green, blue, alpha);
+		}
+	}
+}
+
+int kernel_box_blur(uint32_t width, uint32_t height, const box_blur *blur, const uint32_t *in, uint32_t *out, uint32_t *scratch, const range_runner &run)
+{
+	if(blur->passes > BOX_BLUR_MAX_PASSES)
+		return EXIT_FAILURE;
+
+	for(uint32_t pass = 0; pass < blur->passes; ++pass)
+	{
+		if(blur->radius[pass] > BOX_BLUR_MAX_RADIUS)
+			return EXIT_FAILURE;
+	}
+
+	const uint32_t *source = in;
+
+	if(blur->passes == 0 && in != out)
+		memcpy(out, in, sizeof(uint32_t) * height * width);
+
+	for(uint32_t pass = 0; pass < blur->passes; ++pass)
+	{
+		uint32_t radius = blur->radius[pass];
+
+		run(height, kernel_chain_band_rows(width), [&](uint32_t row_begin, uint32_t row_end)
+		{
+			kernel_box_horizontal(width, height, radius, source, scratch, row_begin, row_end);
+			return EXIT_SUCCESS;
+		});
+
+		run(width, BOX_BLUR_STRIP, [&](uint32_t col_begin, uint32_t col_end)
+		{
+			kernel_box_vertical(width, height, radius, scratch, out, col_begin, col_end);
+			return EXIT_SUCCESS;
+		});
+
+		source = out;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "img_operations.hpp"
+#include "kernels.hpp"
+
+/*
+ * CPU kernels of the box blur. A pass is a horizontal box over the rows
+ * followed by a vertical box over the columns. Both keep a running sum which
+ * is updated by the pixel entering and the pixel leaving the box, so the cost
+ * per pixel does not depend on the radius. The input and output buffers of
+ * the two passes must not overlap.
+ */
+
+/* Number of columns of one strip of the vertical pass. */
+#define BOX_BLUR_STRIP 64
+
+/*
+ * Replaces every pixel of the rows with the rounded mean of the pixels of
+ * the row within the radius. Pixels outside of the image are not counted.
+ */
+extern void kernel_box_horizontal(uint32_t width, uint32_t height, uint32_t radius, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Replaces every pixel of the columns [col_begin, col_end) with the rounded
+ * mean of the pixels of the column within the radius. The columns are walked
+ * row by row with one running sum per column, so the memory is read in order.
+ */
+extern void kernel_box_vertical(uint32_t width, uint32_t height, uint32_t radius, const uint32_t *in, uint32_t *out, uint32_t col_begin, uint32_t col_end);
+
+
+/*
+ * Runs all passes of the blur from in to out, the scratch image holds the
+ * result of the horizontal boxes. The rows and the column strips of a box run
+ * on the runner of the backend. The input may be the output buffer.
+ * Returns EXIT_FAILURE if the blur has too many passes or a too large radius.
+ */
+extern int kernel_box_blur(uint32_t width, uint32_t height, const box_blur *blur, const uint32_t *in, uint32_t *out, uint32_t *scratch, const range_runner &run);
@@ -0,0 +1,516 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include "shared.hpp"
+#include "convolution.hpp"
+
+using namespace std;
+
+bool convolution_separate(const convolution_filter *filter, float *column, float *row)
+{
+	const uint32_t filter_width = filter->width;
+	const uint32_t filter_height = filter->height;
+	const float *weights = filter->weights;
+
+	uint32_t pivot = 0;
+	bool integer = true;
+
+	for(uint32_t i = 0; i < filter_width * filter_height; ++i)
+	{
+		if(fabsf(weights[i]) > fabsf(weights[pivot]))
+			pivot = i;
+
+		if(weights[i] != floorf(weights[i]))
+			integer = false;
+	}
+
+	if(weights[pivot] == 0.0f)
+		return false;
+
+	uint32_t pivot_x = pivot % filter_width;
+	uint32_t pivot_y = pivot / filter_width;
+
+	/* The row of the largest weight is divided by the common divisor of its weights, the column takes the rest. */
+	float divisor = weights[pivot];
+
+	if(integer)
+	{
+		int32_t common = 0;
+
+		for(uint32_t x = 0; x < filter_width; ++x)
+			common = gcd(common, abs((int32_t)weights[pivot_y * filter_width + x]));
+
+		divisor = (float)common;
+	}
+
+	for(uint32_t x = 0; x < filter_width; ++x)
+		row[x] = weights[pivot_y * filter_width + x] / divisor;
+
+	for(uint32_t y = 0; y < filter_height; ++y)
+	{
+		column[y] = weights[y * filter_width + pivot_x] / row[pivot_x];
+
+		if(integer && column[y] != floorf(column[y]))
+			return false;
+	}
+
+	const float tolerance = integer ? 0.0f : 1e-5f * fabsf(weights[pivot]);
+
+	for(uint32_t y = 0; y < filter_height; ++y)
+	{
+		for(uint32_t x = 0; x < filter_width; ++x)
+		{
+			if(fabsf(column[y] * row[x] - weights[y * filter_width + x]) > tolerance)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Maps a coordinate outside of [0, size) into the image for the clamp, mirror
+ * and wrap modes. Returns -1 for the other modes, which have no source pixel.
+ */
+static inline int32_t border_index(int32_t index, int32_t size, uint32_t border)
+{
+	switch(border)
+	{
+		case BORDER_CLAMP:
+			return min(max(index, 0), size - 1);
+		case BORDER_MIRROR:
+		{
+			if(size == 1)
+				return 0;
+
+			/* The border pixel itself is not repeated, -1 becomes 1. */
+			int32_t period = 2 * (size - 1);
+			index = ((index % period) + period) % period;
+
+			return index < size ? index : period - index;
+		}
+		case BORDER_WRAP:
+			return ((index % size) + size) % size;
+	}
+
+	return -1;
+}
+
+/* Converts the channel sums of a pixel to the output pixel. */
+template<typename Acc>
+static inline uint32_t convolve_store(Acc red, Acc green, Acc blue, Acc alpha, float factor, float bias)
+{
+	return RGBA32(
+		(uint8_t)TRUNCATE_CHANNEL((float)red, factor, bias),
+		(uint8_t)TRUNCATE_CHANNEL((float)green, factor, bias),
+		(uint8_t)TRUNCATE_CHANNEL((float)blue, factor, bias),
+		(uint8_t)TRUNCATE_CHANNEL((float)alpha, factor, bias)
+	);
+}
+
+/*
+ * Applies the weights to one pixel within the filter radius of the border.
+ * The taps outside of the image are resolved by the border mode of the filter.
+ */
+template<typename Acc>
+static uint32_t convolve_pixel_border(uint32_t width, uint32_t height, const Acc *weights, int32_t filter_width, int32_t filter_height, const convolution_filter *filter, const uint32_t *in, int32_t row, int32_t col)
+{
+	const int32_t pivot_x = filter_width / 2;
+	const int32_t pivot_y = filter_height / 2;
+	const uint32_t border = filter->border;
+
+	Acc red = 0, green = 0, blue = 0, alpha = 0;
+	Acc total = 0, used = 0;
+
+	for(int32_t filter_y = 0; filter_y < filter_height; ++filter_y)
+	{
+		int32_t filter_y_idx = row - pivot_y + filter_y;
+
+		if(filter_y_idx < 0 || filter_y_idx >= (int32_t)height)
+			filter_y_idx = border_index(filter_y_idx, height, border);
+
+		for(int32_t filter_x = 0; filter_x < filter_width; ++filter_x)
+		{
+			int32_t filter_x_idx = col - pivot_x + filter_x;
+
+			if(filter_x_idx < 0 || filter_x_idx >= (int32_t)width)
+				filter_x_idx = border_index(filter_x_idx, width, border);
+
+			Acc weight = weights[filter_y * filter_width + filter_x];
+			uint32_t pixel;
+
+			total += weight;
+
+			if(filter_y_idx >= 0 && filter_x_idx >= 0)
+				pixel = in[ARRAY2_IDX(filter_y_idx, filter_x_idx, width)];
+			else if(border == BORDER_CONSTANT)
+				pixel = filter->border_color;
+			else
+				continue;
+
+			used += weight;
+			red += weight * (Acc)RED8(pixel);
+			green += weight * (Acc)GREEN8(pixel);
+			blue += weight * (Acc)BLUE8(pixel);
+			alpha += weight * (Acc)ALPHA8(pixel);
+		}
+	}
+
+	float factor = filter->factor;
+
+	/* Weights which sum to 0, like edge filters, have no total to scale to. */
+	if(border == BORDER_RENORMALIZE && used != 0 && total != 0)
+		factor *= (float)total / (float)used;
+
+	return convolve_store(red, green, blue, alpha, factor, filter->bias);
+}
+
+/*
+ * Applies a filter of KW x KH weights with sums of type Acc. The weights are
+ * copied to a local array and the loops over the taps have constant bounds,
+ * so the compiler unrolls them and keeps the weights in registers.
+ * A size of zero reads the size from the filter for the generic version.
+ * Only the strip within the filter radius of the border resolves taps outside
+ * of the image, the loop over the interior has no conditions.
+ */
+template<int KW, int KH, typename Acc>
+static void convolve_fixed(uint32_t width, uint32_t height, const convolution_filter *filter, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	const int32_t filter_width = KW > 0 ? KW : (int32_t)filter->width;
+	const int32_t filter_height = KH > 0 ? KH : (int32_t)filter->height;
+	const int32_t pivot_x = filter_width / 2;
+	const int32_t pivot_y = filter_height / 2;
+	const float factor = filter->factor;
+	const float bias = filter->bias;
+
+	Acc weights[(KW > 0 ? KW : CONVOLUTION_MAX_SIZE) * (KH > 0 ? KH : CONVOLUTION_MAX_SIZE)];
+
+	for(int32_t i = 0; i < filter_width * filter_height; ++i)
+		weights[i] = (Acc)filter->weights[i];
+
+	/* Columns [interior_begin, interior_end) have all taps within the row. */
+	const int32_t interior_begin = min(pivot_x, (int32_t)width);
+	const int32_t interior_end = max((int32_t)width - (filter_width - 1 - pivot_x), interior_begin);
+
+	for(int32_t row = row_begin; row < (int32_t)row_end; ++row)
+	{
+		uint32_t *out_row = out + (size_t)row * width;
+
+		if(row < pivot_y || row + (filter_height - 1 - pivot_y) >= (int32_t)height)
+		{
+			for(int32_t col = 0; col < (int32_t)width; ++col)
+				out_row[col] = convolve_pixel_border(width, height, weights, filter_width, filter_height, filter, in, row, col);
+
+			continue;
+		}
+
+		for(int32_t col = 0; col < interior_begin; ++col)
+			out_row[col] = convolve_pixel_border(width, height, weights, filter_width, filter_height, filter, in, row, col);
+
+		for(int32_t col = interior_begin; col < interior_end; ++col)
+		{
+			const uint32_t *taps = in + (size_t)(row - pivot_y) * width + (col - pivot_x);
+
+			Acc red = 0, green = 0, blue = 0, alpha = 0;
+
+			for(int32_t filter_y = 0; filter_y < filter_height; ++filter_y)
+			{
+				for(int32_t filter_x = 0; filter_x < filter_width; ++filter_x)
+				{
+					uint32_t pixel = taps[(size_t)filter_y * width + filter_x];
+					Acc weight = weights[filter_y * filter_width + filter_x];
+
+					red += weight * (Acc)RED8(pixel);
+					green += weight * (Acc)GREEN8(pixel);
+					blue += weight * (Acc)BLUE8(pixel);
+					alpha += weight * (Acc)ALPHA8(pixel);
+				}
+			}
+
+			out_row[col] = convolve_store(red, green, blue, alpha, factor, bias);
+		}
+
+		for(int32_t col = interior_end; col < (int32_t)width; ++col)
+			out_row[col] = convolve_pixel_border(width, height, weights, filter_width, filter_height, filter, in, row, col);
+	}
+}
+
+/*
+ * Returns true if the weights are integers whose sums stay below 2^24.
+ * Integer sums of these filters are exact and equal to the float sums.
+ */
+static bool convolution_integer(const convolution_filter *filter)
+{
+	float total = 0.0f;
+
+	for(uint32_t i = 0; i < filter->width * filter->height; ++i)
+	{
+		if(filter->weights[i] != floorf(filter->weights[i]))
+			return false;
+
+		total += fabsf(filter->weights[i]);
+	}
+
+	return total * 255.0f < 16777216.0f;
+}
+
+/* Picks the integer or the float sums for a filter of KW x KH weights. */
+template<int KW, int KH>
+static void convolve_fixed_dispatch(uint32_t width, uint32_t height, const convolution_filter *filter, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	if(convolution_integer(filter))
+		convolve_fixed<KW, KH, int32_t>(width, height, filter, in, out, row_begin, row_end);
+	else
+		convolve_fixed<KW, KH, float>(width, height, filter, in, out, row_begin, row_end);
+}
+
+void kernel_convolve_direct(uint32_t width, uint32_t height, const convolution_filter *filter, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	if(filter->width == filter->height)
+	{
+		switch(filter->width)
+		{
+			case 3:
+				convolve_fixed_dispatch<3, 3>(width, height, filter, in, out, row_begin, row_end);
+				return;
+			case 5:
+				convolve_fixed_dispatch<5, 5>(width, height, filter, in, out, row_begin, row_end);
+				return;
+			case 7:
+				convolve_fixed_dispatch<7, 7>(width, height, filter, in, out, row_begin, row_end);
+				return;
+		}
+	}
+
+	/* The generic version only has float sums. */
+	convolve_fixed<0, 0, float>(width, height, filter, in, out, row_begin, row_end);
+}
+
+/*
+ * Horizontal pass for one pixel within the filter radius of the row ends.
+ */
+static void convolve_border_horizontal(uint32_t width, const uint32_t *row, const float *weights, int32_t size, const convolution_filter *filter, int32_t col, float *sum)
+{
+	const int32_t pivot = size / 2;
+
+	float red = 0, green = 0, blue = 0, alpha = 0;
+	float total = 0, used = 0;
+
+	for(int32_t tap = 0; tap < size; ++tap)
+	{
+		int32_t index = col - pivot + tap;
+		uint32_t pixel;
+
+		if(index < 0 || index >= (int32_t)width)
+			index = border_index(index, width, filter->border);
+
+		total += weights[tap];
+
+		if(index >= 0)
+			pixel = row[index];
+		else if(filter->border == BORDER_CONSTANT)
+			pixel = filter->border_color;
+		else
+			continue;
+
+		used += weights[tap];
+		red += weights[tap] * (float)RED8(pixel);
+		green += weights[tap] * (float)GREEN8(pixel);
+		blue += weights[tap] * (float)BLUE8(pixel);
+		alpha += weights[tap] * (float)ALPHA8(pixel);
+	}
+
+	/* The vertical pass scales by the used part of the column, together this is the used part of the filter. */
+	float scale = filter->border == BORDER_RENORMALIZE && used != 0.0f ? total / used : 1.0f;
+
+	sum[0] = red * scale;
+	sum[1] = green * scale;
+	sum[2] = blue * scale;
+	sum[3] = alpha * scale;
+}
+
+/*
+ * Horizontal pass of the separable convolution for one row.
+ * Writes four channel sums per pixel.
+ */
+static void convolve_row_horizontal(uint32_t width, const uint32_t *row, const float *weights, int32_t size, const convolution_filter *filter, float *sums)
+{
+	const int32_t pivot = size / 2;
+	const int32_t interior_begin = min(pivot, (int32_t)width);
+	const int32_t interior_end = max((int32_t)width - (size - 1 - pivot), interior_begin);
+
+	for(int32_t col = 0; col < interior_begin; ++col)
+		convolve_border_horizontal(width, row, weights, size, filter, col, sums + col * 4);
+
+	for(int32_t col = interior_begin; col < interior_end; ++col)
+	{
+		const uint32_t *taps = row + col - pivot;
+
+		float red = 0, green = 0, blue = 0, alpha = 0;
+
+		for(int32_t tap = 0; tap < size; ++tap)
+		{
+			red += weights[tap] * (float)RED8(taps[tap]);
+			green += weights[tap] * (float)GREEN8(taps[tap]);
+			blue += weights[tap] * (float)BLUE8(taps[tap]);
+			alpha += weights[tap] * (float)ALPHA8(taps[tap]);
+		}
+
+		float *sum = sums + col * 4;
+
+		sum[0] = red;
+		sum[1] = green;
+		sum[2] = blue;
+		sum[3] = alpha;
+	}
+
+	for(int32_t col = interior_end; col < (int32_t)width; ++col)
+		convolve_border_horizontal(width, row, weights, size, filter, col, sums + col * 4);
+}
+
+/*
+ * Convolves the rows with the outer product of column and row.
+ * Works like kernel_blur_separable with a rolling window of filter height rows.
+ * The rows within the filter radius of the top and the bottom compute the
+ * horizontal pass of their taps in a second buffer, because the border mode
+ * may map the taps to rows which are not in the window.
+ */
+static int convolve_separable(uint32_t width, uint32_t height, const convolution_filter *filter, const float *column, const float *row_weights, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	const int32_t filter_width = (int32_t)filter->width;
+	const int32_t filter_height = (int32_t)filter->height;
+	const int32_t pivot_y = filter_height / 2;
+	const size_t row_size = (size_t)4 * width;
+
+	float *window = (float *)malloc(sizeof(float) * 2 * filter_height * row_size);
+
+	if(window == NULL)
+		return EXIT_FAILURE;
+
+	float *border_rows = window + filter_height * row_size;
+	float column_total = 0.0f, row_total = 0.0f;
+
+	for(int32_t tap = 0; tap < filter_height; ++tap)
+		column_total += column[tap];
+
+	for(int32_t tap = 0; tap < filter_width; ++tap)
+		row_total += row_weights[tap];
+
+	int32_t next = max((int32_t)row_begin - pivot_y, 0); /* next row for the horizontal pass */
+
+	for(int32_t row = row_begin; row < (int32_t)row_end; ++row)
+	{
+		const int32_t first = row - pivot_y;
+
+		const float *taps[CONVOLUTION_MAX_SIZE];
+		float weights[CONVOLUTION_MAX_SIZE];
+		int32_t count = 0;
+		float factor = filter->factor;
+
+		if(first >= 0 && first + filter_height <= (int32_t)height)
+		{
+			for(next = max(next, first); next < first + filter_height; ++next)
+				convolve_row_horizontal(width, in + (size_t)next * width, row_weights, filter_width, filter, window + (size_t)(next % filter_height) * row_size);
+
+			for(; count < filter_height; ++count)
+			{
+				taps[count] = window + (size_t)((first + count) % filter_height) * row_size;
+				weights[count] = column[count];
+			}
+		}
+		else
+		{
+			float used = 0.0f;
+
+			for(int32_t tap = 0; tap < filter_height; ++tap)
+			{
+				int32_t index = first + tap;
+				float *sums = border_rows + (size_t)count * row_size;
+
+				if(index < 0 || index >= (int32_t)height)
+					index = border_index(index, height, filter->border);
+
+				if(index >= 0)
+				{
+					convolve_row_horizontal(width, in + (size_t)index * width, row_weights, filter_width, filter, sums);
+				}
+				else if(filter->border == BORDER_CONSTANT)
+				{
+					/* Every tap of a row outside of the image has the border color. */
+					for(uint32_t col = 0; col < width; ++col)
+					{
+						sums[col * 4 + 0] = row_total * (float)RED8(filter->border_color);
+						sums[col * 4 + 1] = row_total * (float)GREEN8(filter->border_color);
+						sums[col * 4 + 2] = row_total * (float)BLUE8(filter->border_color);
+						sums[col * 4 + 3] = row_total * (float)ALPHA8(filter->border_color);
+					}
+				}
+				else
+					continue;
+
+				taps[count] = sums;
+				weights[count] = column[tap];
+				used += column[tap];
+				++count;
+			}
+
+			if(filter->border == BORDER_RENORMALIZE && used != 0.0f)
+				factor *= column_total / used;
+		}
+
+		uint32_t *out_row = out + (size_t)row * width;
+
+		for(uint32_t col = 0; col < width; ++col)
+		{
+			float sums[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+			for(int32_t tap = 0; tap < count; ++tap)
+			{
+				const float *sum = taps[tap] + col * 4;
+
+				sums[0] += weights[tap] * sum[0];
+				sums[1] += weights[tap] * sum[1];
+				sums[2] += weights[tap] * sum[2];
+				sums[3] += weights[tap] * sum[3];
+			}
+
+			out_row[col] = convolve_store(sums[0], sums[1], sums[2], sums[3], factor, filter->bias);
+		}
+	}
+
+	free(window);
+
+	return EXIT_SUCCESS;
+}
+
+int kernel_convolve(uint32_t width, uint32_t height, const convolution_filter *filter, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	if(filter->width == 0 || filter->height == 0 || filter->width > CONVOLUTION_MAX_SIZE || filter->height > CONVOLUTION_MAX_SIZE)
+		return EXIT_FAILURE;
+
+	if(filter->border > BORDER_RENORMALIZE)
+		return EXIT_FAILURE;
+
+	if(row_begin >= row_end)
+		return EXIT_SUCCESS;
+
+	float column[CONVOLUTION_MAX_SIZE], row[CONVOLUTION_MAX_SIZE];
+
+	/*
+	 * A 1x1 filter gains nothing from two passes. The passes renormalize separately,
+	 * which only equals the renormalization of the full filter without negative weights.
+	 */
+	bool separable = filter->width * filter->height > 1 && convolution_separate(filter, column, row);
+
+	for(uint32_t i = 0; separable && filter->border == BORDER_RENORMALIZE && i < filter->width * filter->height; ++i)
+		separable = filter->weights[i] >= 0.0f;
+
+	if(separable)
+		return convolve_separable(width, height, filter, column, row, in, out, row_begin, row_end);
+
+	kernel_convolve_direct(width, height, filter, in, out, row_begin, row_end);
+
+	return EXIT_SUCCESS;
+}
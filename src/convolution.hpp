@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "img_operations.hpp"
+
+/*
+ * Row based CPU kernels for arbitrary convolution filters.
+ * Like the kernels of kernels.hpp they process the rows [row_begin, row_end)
+ * and the input and output buffers must not overlap.
+ */
+
+/*
+ * Splits the filter into a column and a row vector whose outer product is the filter.
+ * Filters with integer weights are only split into integer vectors, so the
+ * sums of both passes are exact and equal to the sums of the full filter.
+ * Returns false if the filter is not separable.
+ */
+extern bool convolution_separate(const convolution_filter *filter, float *column, float *row);
+
+/*
+ * Applies the full filter to the rows without splitting it. The square sizes
+ * 3, 5 and 7 have unrolled versions which sum filters with integer weights
+ * in integers, all other sizes run on a generic version.
+ */
+extern void kernel_convolve_direct(uint32_t width, uint32_t height, const convolution_filter *filter, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Convolves the rows with the filter. Separable filters run as a horizontal and
+ * a vertical pass, all other filters run on kernel_convolve_direct.
+ * Returns EXIT_FAILURE if the filter is invalid or there is no memory.
+ */
+extern int kernel_convolve(uint32_t width, uint32_t height, const convolution_filter *filter, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
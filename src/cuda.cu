@@ -1,7 +1,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "shared.hpp"
+#include "img_operations.hpp"
 
 /* Get the index via the CUDA block and thread index. */
 #define IDX(bIdx,bDim,tIdx,size) ARRAY2_IDX((bIdx.y * bDim.y + tIdx.y),((bIdx.x * bDim.x) + tIdx.x), size)
@@ -169,7 +171,7 @@ dim3 cuda_blocks(uint32_t x, uint32_t y, dim3 threads)
 /*
  * Executes and distributes the specified kernel.
  */
-int execute_cuda_kernel(uint32_t kernel, uint32_t width, uint32_t height, uint32_t *data)
+int execute_cuda_kernel(uint32_t kernel, uint32_t width, uint32_t height, const uint32_t *data_in, uint32_t *data_out)
 {
 	size_t size = sizeof(uint32_t) * width * height;
 
@@ -178,7 +180,7 @@ int execute_cuda_kernel(uint32_t kernel, uint32_t width, uint32_t height, uint32
 	/* Allocate CUDA buffers. */
 	CUDA_ERROR_CHECK(cudaMalloc((void **) &in, size));
 	CUDA_ERROR_CHECK(cudaMalloc((void **) &out, size));
-	CUDA_ERROR_CHECK(cudaMemcpy(in, data, size, cudaMemcpyHostToDevice));
+	CUDA_ERROR_CHECK(cudaMemcpy(in, data_in, size, cudaMemcpyHostToDevice));
 
 	/* Define distribution levels. */
 	dim3 threads(32,32);
@@ -200,8 +202,8 @@ int execute_cuda_kernel(uint32_t kernel, uint32_t width, uint32_t height, uint32
 			return EXIT_FAILURE;
 	}
 
-	/* Copy CUDA buffer back to source array and free allocated buffers. */
-	CUDA_ERROR_CHECK(cudaMemcpy(data, out, size, cudaMemcpyDeviceToHost));
+	/* Copy CUDA buffer back to the output array and free allocated buffers. */
+	CUDA_ERROR_CHECK(cudaMemcpy(data_out, out, size, cudaMemcpyDeviceToHost));
 	CUDA_ERROR_CHECK(cudaFree(in));
 	CUDA_ERROR_CHECK(cudaFree(out));
 
@@ -211,31 +213,178 @@ int execute_cuda_kernel(uint32_t kernel, uint32_t width, uint32_t height, uint32
 /*
  * Greyscales the colors of the image.
  */
+int op_grey(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	return execute_cuda_kernel(OP_KERNEL_GREY, width, height, in, out);
+}
+
 int op_grey(uint32_t width, uint32_t height, uint32_t *data)
 {
-	return execute_cuda_kernel(OP_KERNEL_GREY, width, height, data);
+	return execute_cuda_kernel(OP_KERNEL_GREY, width, height, data, data);
 }
 
 /*
  * Converts the colorspace from rgba to hsv.
  */
+int op_hsv(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	return execute_cuda_kernel(OP_KERNEL_HSV, width, height, in, out);
+}
+
 int op_hsv(uint32_t width, uint32_t height, uint32_t *data)
 {
-	return execute_cuda_kernel(OP_KERNEL_HSV, width, height, data);
+	return execute_cuda_kernel(OP_KERNEL_HSV, width, height, data, data);
 }
 
 /*
  * Applies a emboss filter to the image.
  */
+int op_emboss(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	return execute_cuda_kernel(0, width, height, in, out);
+}
+
 int op_emboss(uint32_t width, uint32_t height, uint32_t *data)
 {
-	return execute_cuda_kernel(0, width, height, data);
+	return execute_cuda_kernel(0, width, height, data, data);
 }
 
 /*
  * Applies a gaussian blur filter to the image.
  */
+int op_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	return execute_cuda_kernel(OP_KERNEL_BLUR, width, height, in, out);
+}
+
 int op_blur(uint32_t width, uint32_t height, uint32_t *data)
 {
-	return execute_cuda_kernel(OP_KERNEL_BLUR, width, height, data);
-}
\ No newline at end of file
+	return execute_cuda_kernel(OP_KERNEL_BLUR, width, height, data, data);
+}
+
+/*
+ * Convolutions with a runtime filter are not implemented for CUDA.
+ */
+int op_convolve(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const convolution_filter *filter)
+{
+	return EXIT_FAILURE;
+}
+
+int op_convolve(uint32_t width, uint32_t height, uint32_t *data, const convolution_filter *filter)
+{
+	return EXIT_FAILURE;
+}
+
+/*
+ * The box blur is not implemented for CUDA.
+ */
+int op_box_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const box_blur *blur)
+{
+	return EXIT_FAILURE;
+}
+
+int op_box_blur(uint32_t width, uint32_t height, uint32_t *data, const box_blur *blur)
+{
+	return EXIT_FAILURE;
+}
+
+/*
+ * Lookup tables are not implemented for CUDA.
+ */
+int op_lut(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const point_lut *lut)
+{
+	return EXIT_FAILURE;
+}
+
+int op_lut(uint32_t width, uint32_t height, uint32_t *data, const point_lut *lut)
+{
+	return EXIT_FAILURE;
+}
+
+/*
+ * The hsv adjustments are not implemented for CUDA.
+ */
+int op_hsv_adjust(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const hsv_adjust *adjust)
+{
+	return EXIT_FAILURE;
+}
+
+int op_hsv_adjust(uint32_t width, uint32_t height, uint32_t *data, const hsv_adjust *adjust)
+{
+	return EXIT_FAILURE;
+}
+
+/*
+ * Runs a chain of operations. Every operation is its own kernel launch,
+ * the buffers are switched between data and scratch.
+ */
+int op_chain(uint32_t width, uint32_t height, const op_step *steps, uint32_t count, uint32_t *data, uint32_t *scratch)
+{
+	uint32_t *in = data, *out = scratch;
+
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		int success = EXIT_FAILURE;
+
+		switch(steps[i].op)
+		{
+			case OP_GREY:
+				success = op_grey(width, height, in, out);
+				break;
+			case OP_HSV:
+				success = i == count - 1 ? op_hsv(width, height, in, out) : EXIT_FAILURE;
+				break;
+			case OP_EMBOSS:
+				success = op_emboss(width, height, in, out);
+				break;
+			case OP_BLUR:
+				success = op_blur(width, height, in, out);
+				break;
+			case OP_CONVOLVE:
+				success = op_convolve(width, height, in, out, (const convolution_filter *)steps[i].args);
+				break;
+			case OP_BOX_BLUR:
+				success = op_box_blur(width, height, in, out, (const box_blur *)steps[i].args);
+				break;
+			case OP_LUT:
+				success = op_lut(width, height, in, out, (const point_lut *)steps[i].args);
+				break;
+			case OP_HSV_ADJUST:
+				success = op_hsv_adjust(width, height, in, out, (const hsv_adjust *)steps[i].args);
+				break;
+		}
+
+		if(success != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+
+		uint32_t *tmp = in;
+		in = out;
+		out = tmp;
+	}
+
+	if(in != data)
+		memcpy(data, in, sizeof(uint32_t) * height * width);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Runs the tasks one after another on the caller.
+ */
+uint32_t op_threads()
+{
+	return 1;
+}
+
+unsigned op_run_tasks(unsigned (*task)(void *, size_t), void *data, size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		unsigned error = task(data, i);
+
+		if(error)
+			return error;
+	}
+
+	return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+/*
+ * Float conversions between rgb and hsv. Unlike the byte format of op_hsv
+ * they keep the full precision, so a round trip gives back the same colors.
+ * The hue is given in sectors of 60 degrees [0, 6), the saturation in [0, 1]
+ * and the value like the channels in [0, 255].
+ */
+
+static inline void hsv_from_rgb(float red, float green, float blue, float &hue, float &saturation, float &value)
+{
+	float cmax = fmaxf(red, fmaxf(green, blue));
+	float cmin = fminf(red, fminf(green, blue));
+	float diff = cmax - cmin;
+
+	hue = 0.0f;
+
+	if(diff > 0.0f)
+	{
+		if(cmax == red)
+		{
+			hue = (green - blue) / diff;
+
+			if(hue < 0.0f)
+				hue += 6.0f;
+		}
+		else if(cmax == green)
+			hue = 2.0f + (blue - red) / diff;
+		else
+			hue = 4.0f + (red - green) / diff;
+	}
+
+	saturation = cmax > 0.0f ? diff / cmax : 0.0f;
+	value = cmax;
+}
+
+static inline void hsv_to_rgb(float hue, float saturation, float value, float &red, float &green, float &blue)
+{
+	float sector = floorf(hue);
+	float fraction = hue - sector;
+
+	float p = value * (1.0f - saturation);
+	float q = value * (1.0f - saturation * fraction);
+	float t = value * (1.0f - saturation * (1.0f - fraction));
+
+	switch((int32_t)sector)
+	{
+		case 1:
+			red = q; green = value; blue = p;
+			break;
+		case 2:
+			red = p; green = value; blue = t;
+			break;
+		case 3:
+			red = p; green = q; blue = value;
+			break;
+		case 4:
+			red = t; green = p; blue = value;
+			break;
+		case 5:
+			red = value; green = p; blue = q;
+			break;
+		default:
+			red = value; green = t; blue = p;
+			break;
+	}
+}
+
+/*
+ * Returns the rotation of the hue in sectors [0, 6) for a rotation in degrees.
+ */
+static inline float hsv_hue_shift(float degrees)
+{
+	float shift = fmodf(degrees / 60.0f, 6.0f);
+
+	if(shift < 0.0f)
+		shift += 6.0f;
+
+	/* A tiny negative rotation rounds up to a full turn. */
+	return shift >= 6.0f ? 0.0f : shift;
+}
@@ -5,10 +5,155 @@
 
 using namespace std;
 
+/*
+ * Every operation exists in two variants. The first one modifies the image in place.
+ * The second one reads the input image and writes the result to the output image,
+ * which lets a pipeline switch between two preallocated buffers without any copies.
+ * Both buffers hold width * height pixels. For op_grey, op_lut, op_hsv_adjust and
+ * op_box_blur the output may be the input buffer (in == out). The other operations
+ * read the neighbours of a pixel or change the pixel format, so their output must
+ * be a separate buffer. Buffers which overlap only partially are never allowed.
+ * The in place variants use whatever their backend supports.
+ */
+
 extern int op_grey(uint32_t width, uint32_t height, uint32_t *data);
 
+extern int op_grey(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out);
+
+/* The output holds three bytes per pixel in the first three quarters of the buffer. */
 extern int op_hsv(uint32_t width, uint32_t height, uint32_t *data);
 
+extern int op_hsv(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out);
+
 extern int op_emboss(uint32_t width, uint32_t height, uint32_t *data);
 
-extern int op_blur(uint32_t width, uint32_t height, uint32_t *data);
\ No newline at end of file
+extern int op_emboss(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out);
+
+extern int op_blur(uint32_t width, uint32_t height, uint32_t *data);
+
+extern int op_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out);
+
+/* Maximum width and height of a convolution filter. */
+#define CONVOLUTION_MAX_SIZE 15
+
+/* Border modes of a convolution filter, they define the pixels outside of the image. */
+#define BORDER_SKIP 0        /* taps outside of the image are skipped like in op_blur */
+#define BORDER_CLAMP 1       /* the nearest pixel of the image */
+#define BORDER_MIRROR 2      /* the image mirrored at the border pixels */
+#define BORDER_WRAP 3        /* the image repeated */
+#define BORDER_CONSTANT 4    /* the border color */
+#define BORDER_RENORMALIZE 5 /* taps are skipped and the sum is scaled to the total weight unless that is 0 */
+
+/*
+ * A filter of width x height weights stored row by row. The weights are centered
+ * on the pixel at (width / 2, height / 2). Every channel of the result is
+ * factor * sum + bias clamped to [0, 255]. The border mode defines the taps
+ * outside of the image, the border color is only used by BORDER_CONSTANT.
+ */
+struct convolution_filter
+{
+	uint32_t width;
+	uint32_t height;
+	float weights[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+	float factor;
+	float bias;
+	uint32_t border;
+	uint32_t border_color;
+};
+
+extern int op_convolve(uint32_t width, uint32_t height, uint32_t *data, const convolution_filter *filter);
+
+extern int op_convolve(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const convolution_filter *filter);
+
+/* Largest radius and number of passes of a box blur. */
+#define BOX_BLUR_MAX_RADIUS 2047
+#define BOX_BLUR_MAX_PASSES 8
+
+/*
+ * A box blur replaces every pixel with the mean of the pixels within the radius,
+ * the pixels outside of the image are not counted. Every pass blurs the result of
+ * the previous pass with its own radius. Three passes of the right radii come close
+ * to a gaussian blur, the cost per pixel does not depend on the radius.
+ */
+struct box_blur
+{
+	uint32_t passes;
+	uint32_t radius[BOX_BLUR_MAX_PASSES];
+};
+
+extern int op_box_blur(uint32_t width, uint32_t height, uint32_t *data, const box_blur *blur);
+
+extern int op_box_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const box_blur *blur);
+
+/*
+ * A point operation maps every channel value to a new value of the same channel.
+ * The tables hold the new values of red, green, blue and alpha, so curves like
+ * gamma, brightness or contrast cost one table lookup per channel.
+ */
+struct point_lut
+{
+	uint8_t table[4][256];
+};
+
+extern int op_lut(uint32_t width, uint32_t height, uint32_t *data, const point_lut *lut);
+
+extern int op_lut(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const point_lut *lut);
+
+/*
+ * Adjustments in the hsv colorspace. The hue is rotated by hue degrees, the
+ * saturation and the value are scaled by their factors and clamped. The pixels
+ * are converted to hsv and back in one pass, the alpha channel stays untouched.
+ */
+struct hsv_adjust
+{
+	float hue;
+	float saturation;
+	float value;
+};
+
+extern int op_hsv_adjust(uint32_t width, uint32_t height, uint32_t *data, const hsv_adjust *adjust);
+
+extern int op_hsv_adjust(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const hsv_adjust *adjust);
+
+/* Operation codes for op_chain. */
+#define OP_GREY 1
+#define OP_HSV 2
+#define OP_EMBOSS 3
+#define OP_BLUR 4
+#define OP_CONVOLVE 5
+#define OP_BOX_BLUR 6
+#define OP_LUT 7
+#define OP_HSV_ADJUST 8
+
+/* Maximum number of operations in one chain. */
+#define OP_CHAIN_MAX 32
+
+/*
+ * An operation of a chain. Args points to the parameters of the operation,
+ * which is the convolution_filter for OP_CONVOLVE, the box_blur for OP_BOX_BLUR,
+ * the point_lut for OP_LUT, the hsv_adjust for OP_HSV_ADJUST and NULL for the others.
+ */
+struct op_step
+{
+	uint32_t op;
+	const void *args;
+};
+
+/*
+ * Runs the operations one after another on the image in data.
+ * The scratch buffer has the same size and holds the intermediate images.
+ * Point operations (grey, lut, hsv adjustments and hsv) are fused into the preceding operation where
+ * the backend supports it, so the image is streamed through memory only once.
+ * The hsv operation changes the pixel format and can only be the last operation.
+ */
+extern int op_chain(uint32_t width, uint32_t height, const op_step *steps, uint32_t count, uint32_t *data, uint32_t *scratch);
+
+/* Number of cpu threads the backend runs its work on, 1 for the serial backends. */
+extern uint32_t op_threads();
+
+/*
+ * Runs task(data, i) for every i in [0, count) on the cpu threads of the backend
+ * and returns the first error of a task or 0. The tasks must not depend on each
+ * other. The front ends use it to deflate and inflate the segments of a png.
+ */
+extern unsigned op_run_tasks(unsigned (*task)(void *data, size_t index), void *data, size_t count);
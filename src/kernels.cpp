@@ -0,0 +1,755 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "shared.hpp"
+#include "kernels.hpp"
+#include "simd.hpp"
+#include "planar.hpp"
+#include "convolution.hpp"
+#include "box_blur.hpp"
+#include "hsv.hpp"
+
+/* Basic inlined math operations for the rgb format. */
+#define MAXRGB(r,g,b) (std::max(std::max(r, g), b))
+#define MINRGB(r,g,b) (std::min(std::min(r, g), b))
+
+using namespace std;
+
+/* Greyscales one pixel, the vectorized kernels in simd.cpp use the same arithmetic. */
+static inline uint32_t grey_pixel(uint32_t pixel)
+{
+	uint8_t color =
+		  (0.21 * RED8(pixel))
+		+ (0.72 * GREEN8(pixel))
+		+ (0.07 * BLUE8(pixel));
+
+	return RGBA32(color, color, color, ALPHA8(pixel));
+}
+
+void kernel_grey(uint32_t width, uint32_t /*height*/, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	/* The rows are contiguous, so they are processed as one run of pixels. */
+	size_t begin = (size_t)row_begin * width;
+	size_t end = (size_t)row_end * width;
+
+	switch(simd_level())
+	{
+		case SIMD_AVX2:
+			begin += simd_grey_avx2(in + begin, out + begin, end - begin);
+			break;
+		case SIMD_SSE41:
+			begin += simd_grey_sse41(in + begin, out + begin, end - begin);
+			break;
+	}
+
+	for(size_t index = begin; index < end; ++index)
+		out[index] = grey_pixel(in[index]);
+}
+
+/* Converts one pixel to hsv and writes the three channels. */
+static inline void hsv_pixel(uint32_t pixel, uint8_t *out)
+{
+	uint8_t red = RED8(pixel);
+	uint8_t green = GREEN8(pixel);
+	uint8_t blue = BLUE8(pixel);
+
+	/* Calulate conversion parameters */
+	uint8_t cmax = MAXRGB(red, green, blue);
+	uint8_t cmin = MINRGB(red, green, blue);
+	uint8_t diff = cmax - cmin;
+
+	/* Calculate hue. 200 + 171 keeps the output compatible with OpenCV, see docs/Documentation.md. */
+	uint8_t hue = 0;
+
+	if(diff != 0)
+	{
+		if(cmax == red)
+			hue = 43 * ((green - blue) / diff);
+		else if(cmax == green)
+			hue = 85 + 43 * ((blue - red) / diff);
+		else
+			hue = 200 + 171 + 43 * ((red - green) / diff);
+	}
+
+	out[0] = hue;
+	out[1] = cmax == 0 ? 0 : 255 * diff / cmax;
+	out[2] = cmax;
+}
+
+void kernel_hsv(uint32_t width, uint32_t /*height*/, const uint32_t *in, uint8_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	size_t begin = (size_t)row_begin * width;
+	size_t end = (size_t)row_end * width;
+
+	switch(simd_level())
+	{
+		case SIMD_AVX2:
+			begin += simd_hsv_avx2(in + begin, out + begin * 3, end - begin);
+			break;
+		case SIMD_SSE41:
+			begin += simd_hsv_sse41(in + begin, out + begin * 3, end - begin);
+			break;
+	}
+
+	for(size_t index = begin; index < end; ++index)
+		hsv_pixel(in[index], out + index * 3); // hsv has only 3 channels
+}
+
+/* Adjusts a pixel in the hsv colorspace, the hue shift is given in sectors. */
+static inline uint32_t hsv_adjust_pixel(uint32_t pixel, float hue_shift, float saturation_factor, float value_factor)
+{
+	float hue, saturation, value;
+	float red, green, blue;
+
+	hsv_from_rgb((float)RED8(pixel), (float)GREEN8(pixel), (float)BLUE8(pixel), hue, saturation, value);
+
+	hue += hue_shift;
+
+	if(hue >= 6.0f)
+		hue -= 6.0f;
+
+	saturation = fminf(saturation * saturation_factor, 1.0f);
+	value = fminf(value * value_factor, 255.0f);
+
+	hsv_to_rgb(hue, saturation, value, red, green, blue);
+
+	return RGBA32(
+		(uint32_t)(red + 0.5f),
+		(uint32_t)(green + 0.5f),
+		(uint32_t)(blue + 0.5f),
+		ALPHA8(pixel)
+	);
+}
+
+void kernel_hsv_adjust(uint32_t width, uint32_t /*height*/, const hsv_adjust *adjust, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	float hue_shift = hsv_hue_shift(adjust->hue);
+	float saturation = fmaxf(adjust->saturation, 0.0f);
+	float value = fmaxf(adjust->value, 0.0f);
+
+	size_t begin = (size_t)row_begin * width;
+	size_t end = (size_t)row_end * width;
+
+	if(simd_level() == SIMD_AVX2)
+		begin += simd_hsv_adjust_avx2(in + begin, out + begin, end - begin, hue_shift, saturation, value);
+
+	for(size_t index = begin; index < end; ++index)
+		out[index] = hsv_adjust_pixel(in[index], hue_shift, saturation, value);
+}
+
+void kernel_lut(uint32_t width, uint32_t /*height*/, const point_lut *lut, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	/* The values are shifted to their channel, so a pixel is the or of four lookups. */
+	uint32_t tables[4][256];
+
+	for(uint32_t channel = 0; channel < 4; ++channel)
+	{
+		for(uint32_t value = 0; value < 256; ++value)
+			tables[channel][value] = (uint32_t)lut->table[channel][value] << (8 * channel);
+	}
+
+	size_t begin = (size_t)row_begin * width;
+	size_t end = (size_t)row_end * width;
+
+	if(simd_level() == SIMD_AVX2)
+		begin += simd_lut_avx2(tables[0], in + begin, out + begin, end - begin);
+
+	for(size_t index = begin; index < end; ++index)
+	{
+		uint32_t pixel = in[index];
+
+		out[index] = tables[0][RED8(pixel)] | tables[1][GREEN8(pixel)] | tables[2][BLUE8(pixel)] | tables[3][ALPHA8(pixel)];
+	}
+}
+
+void kernel_lut_compose(const point_lut *first, const point_lut *second, point_lut *out)
+{
+	for(uint32_t channel = 0; channel < 4; ++channel)
+	{
+		for(uint32_t value = 0; value < 256; ++value)
+			out->table[channel][value] = second->table[channel][first->table[channel][value]];
+	}
+}
+
+/* Embosses a pixel with its top left neighbour. */
+static inline uint32_t emboss_pixel(uint32_t pixel, uint32_t top_left)
+{
+	/* Calculate difference between color values. */
+	int32_t diff_red = RED8(pixel) - RED8(top_left);
+	int32_t diff_green = GREEN8(pixel) - GREEN8(top_left);
+	int32_t diff_blue = BLUE8(pixel) - BLUE8(top_left);
+
+	/* Use the maximum difference as color value. */
+	uint32_t color = 128 + max(diff_red, max(diff_green, diff_blue));
+
+	return RGBA32(
+		(uint8_t)color,
+		(uint8_t)color,
+		(uint8_t)color,
+		ALPHA8(pixel)
+	);
+}
+
+void kernel_emboss_row(uint32_t width, const uint32_t *row, const uint32_t *top, uint32_t *out)
+{
+	if(width == 0)
+		return;
+
+	/* The first pixel has no left neighbour and uses the pixel above. */
+	out[0] = emboss_pixel(row[0], top[0]);
+
+	uint32_t col = 1;
+
+	switch(simd_level())
+	{
+		case SIMD_AVX2:
+			col += simd_emboss_avx2(row + 1, top, out + 1, width - 1);
+			break;
+		case SIMD_SSE41:
+			col += simd_emboss_sse41(row + 1, top, out + 1, width - 1);
+			break;
+	}
+
+	for(; col < width; ++col)
+		out[col] = emboss_pixel(row[col], top[col - 1]);
+}
+
+void kernel_emboss(uint32_t width, uint32_t /*height*/, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	for(uint32_t row = row_begin; row < row_end; ++row)
+	{
+		uint32_t top = row > 0 ? row - 1 : 0;
+
+		kernel_emboss_row(width, in + (size_t)row * width, in + (size_t)top * width, out + (size_t)row * width);
+	}
+}
+
+void kernel_emboss_in_place(uint32_t width, uint32_t *data, const uint32_t *top, uint32_t row_begin, uint32_t row_end)
+{
+	/* Bottom up every row still has the original row above it. */
+	for(uint32_t row = row_end; row-- > row_begin + 1;)
+		kernel_emboss_row(width, data + (size_t)row * width, data + (size_t)(row - 1) * width, data + (size_t)row * width);
+
+	if(row_begin < row_end)
+		kernel_emboss_row(width, data + (size_t)row_begin * width, top, data + (size_t)row_begin * width);
+}
+
+void kernel_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	static const convolution_filter filter =
+	{
+		5, 5,
+		{
+			1.0f,  4.0f,  6.0f,  4.0f,  1.0f,
+			4.0f, 16.0f, 24.0f, 16.0f,  4.0f,
+			6.0f, 24.0f, 36.0f, 24.0f,  6.0f,
+			4.0f, 16.0f, 24.0f, 16.0f,  4.0f,
+			1.0f,  4.0f,  6.0f,  4.0f,  1.0f
+		},
+		1.0f / 256.0f,
+		0.0f,
+		BORDER_SKIP,
+		0
+	};
+
+	/* The full filter with the unrolled 5x5 convolution, the blur operations use the separable kernels below. */
+	kernel_convolve_direct(width, height, &filter, in, out, row_begin, row_end);
+}
+
+/* Weights of the separable 5x5 gaussian filter, the outer product is the filter of kernel_blur. */
+static const float blur_weights[5] = {1.0f, 4.0f, 6.0f, 4.0f, 1.0f};
+
+/* Adds the weighted channels of the pixel to the four float sums. */
+static inline void blur_tap(float *sums, uint32_t pixel, float weight)
+{
+	sums[0] += weight * (float)RED8(pixel);
+	sums[1] += weight * (float)GREEN8(pixel);
+	sums[2] += weight * (float)BLUE8(pixel);
+	sums[3] += weight * (float)ALPHA8(pixel);
+}
+
+/*
+ * Horizontal pass for one row. Writes four channel sums per pixel.
+ * Taps outside of the row are skipped like in kernel_blur.
+ */
+static void blur_row_horizontal(uint32_t width, const uint32_t *row, float *sums)
+{
+	int32_t size = (int32_t)width;
+	int32_t interior_end = max(size - 2, 2);
+
+	for(int32_t col = 0; col < size; ++col)
+	{
+		float *sum = sums + col * 4;
+
+		sum[0] = sum[1] = sum[2] = sum[3] = 0.0f;
+
+		/* The interior has all five taps, so the bounds checks are only needed at the borders. */
+		if(col >= 2 && col < interior_end)
+		{
+			blur_tap(sum, row[col - 2], blur_weights[0]);
+			blur_tap(sum, row[col - 1], blur_weights[1]);
+			blur_tap(sum, row[col], blur_weights[2]);
+			blur_tap(sum, row[col + 1], blur_weights[3]);
+			blur_tap(sum, row[col + 2], blur_weights[4]);
+			continue;
+		}
+
+		for(int32_t tap = max(col - 2, 0); tap < min(col + 3, size); ++tap)
+			blur_tap(sum, row[tap], blur_weights[tap - col + 2]);
+	}
+}
+
+int kernel_blur_separable(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	const float filter_factor = 1.0f / 256.0f;
+	const float filter_bias = 0.0f;
+
+	if(row_begin >= row_end)
+		return EXIT_SUCCESS;
+
+	/* Rolling window with the horizontal sums of five rows, indexed by row % 5. */
+	float *window = (float *)malloc(sizeof(float) * 4 * 5 * width);
+
+	if(window == NULL)
+		return EXIT_FAILURE;
+
+	int32_t last = (int32_t)height - 1;
+	int32_t next = max((int32_t)row_begin - 2, 0); /* next row for the horizontal pass */
+
+	for(int32_t row = row_begin; row < (int32_t)row_end; ++row)
+	{
+		int32_t first_tap = max(row - 2, 0);
+		int32_t last_tap = min(row + 2, last);
+
+		/* The input row is consumed here, so the output may overwrite it later. */
+		for(; next <= last_tap; ++next)
+			blur_row_horizontal(width, in + (size_t)next * width, window + (size_t)(next % 5) * 4 * width);
+
+		const float *taps[5];
+		float weights[5];
+		int32_t count = 0;
+
+		for(int32_t tap = first_tap; tap <= last_tap; ++tap, ++count)
+		{
+			taps[count] = window + (size_t)(tap % 5) * 4 * width;
+			weights[count] = blur_weights[tap - row + 2];
+		}
+
+		uint32_t *out_row = out + (size_t)row * width;
+
+		/* Vertical pass, streams through the window rows instead of striding over the image. */
+		for(uint32_t col = 0; col < width; ++col)
+		{
+			float sums[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+			for(int32_t tap = 0; tap < count; ++tap)
+			{
+				const float *sum = taps[tap] + col * 4;
+
+				sums[0] += weights[tap] * sum[0];
+				sums[1] += weights[tap] * sum[1];
+				sums[2] += weights[tap] * sum[2];
+				sums[3] += weights[tap] * sum[3];
+			}
+
+			out_row[col] = RGBA32(
+				(uint8_t)TRUNCATE_CHANNEL(sums[0], filter_factor, filter_bias),
+				(uint8_t)TRUNCATE_CHANNEL(sums[1], filter_factor, filter_bias),
+				(uint8_t)TRUNCATE_CHANNEL(sums[2], filter_factor, filter_bias),
+				(uint8_t)TRUNCATE_CHANNEL(sums[3], filter_factor, filter_bias)
+			);
+		}
+	}
+
+	free(window);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Spreads the four channels of a pixel into 16 bit lanes of a 64 bit integer.
+ * The weighted sums of the blur stay below 65536, so all four channels
+ * can be multiplied and added at once without carrying into the next lane.
+ */
+static inline uint64_t blur_spread(uint32_t pixel)
+{
+	uint64_t p = pixel;
+
+	return (p & 0xFF)
+		| ((p & 0xFF00) << 8)
+		| ((p & 0xFF0000) << 16)
+		| ((p & 0xFF000000) << 24);
+}
+
+/* Divides the lanes by 256 and packs them back into a pixel. */
+static inline uint32_t blur_pack(uint64_t sums)
+{
+	return (uint32_t)(
+		  ((sums >> 8) & 0xFF)
+		| ((sums >> 16) & 0xFF00)
+		| ((sums >> 24) & 0xFF0000)
+		| ((sums >> 32) & 0xFF000000));
+}
+
+static const uint64_t blur_weights_integer[5] = {1, 4, 6, 4, 1};
+
+/*
+ * Horizontal pass of the integer blur for one row.
+ */
+static void blur_row_horizontal_integer(uint32_t width, const uint32_t *row, uint64_t *sums)
+{
+	int32_t size = (int32_t)width;
+
+	for(int32_t col = 0; col < size; ++col)
+	{
+		if(col >= 2 && col < size - 2)
+		{
+			sums[col] = blur_spread(row[col - 2]) + blur_spread(row[col + 2])
+				+ 4 * (blur_spread(row[col - 1]) + blur_spread(row[col + 1]))
+				+ 6 * blur_spread(row[col]);
+			continue;
+		}
+
+		uint64_t sum = 0;
+
+		for(int32_t tap = max(col - 2, 0); tap < min(col + 3, size); ++tap)
+			sum += blur_weights_integer[tap - col + 2] * blur_spread(row[tap]);
+
+		sums[col] = sum;
+	}
+}
+
+int kernel_blur_separable_integer(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	if(row_begin >= row_end)
+		return EXIT_SUCCESS;
+
+	/* Same rolling window as kernel_blur_separable with one lane packed integer per pixel. */
+	uint64_t *window = (uint64_t *)malloc(sizeof(uint64_t) * 5 * width);
+
+	if(window == NULL)
+		return EXIT_FAILURE;
+
+	int32_t last = (int32_t)height - 1;
+	int32_t next = max((int32_t)row_begin - 2, 0);
+
+	for(int32_t row = row_begin; row < (int32_t)row_end; ++row)
+	{
+		int32_t first_tap = max(row - 2, 0);
+		int32_t last_tap = min(row + 2, last);
+
+		for(; next <= last_tap; ++next)
+			blur_row_horizontal_integer(width, in + (size_t)next * width, window + (size_t)(next % 5) * width);
+
+		uint32_t *out_row = out + (size_t)row * width;
+
+		if(last_tap - first_tap == 4)
+		{
+			const uint64_t *a = window + (size_t)((row - 2) % 5) * width;
+			const uint64_t *b = window + (size_t)((row - 1) % 5) * width;
+			const uint64_t *c = window + (size_t)(row % 5) * width;
+			const uint64_t *d = window + (size_t)((row + 1) % 5) * width;
+			const uint64_t *e = window + (size_t)((row + 2) % 5) * width;
+
+			for(uint32_t col = 0; col < width; ++col)
+				out_row[col] = blur_pack(a[col] + e[col] + 4 * (b[col] + d[col]) + 6 * c[col]);
+
+			continue;
+		}
+
+		/* Rows at the top and bottom skip the taps outside of the image. */
+		for(uint32_t col = 0; col < width; ++col)
+		{
+			uint64_t sum = 0;
+
+			for(int32_t tap = first_tap; tap <= last_tap; ++tap)
+				sum += blur_weights_integer[tap - row + 2] * window[(size_t)(tap % 5) * width + col];
+
+			out_row[col] = blur_pack(sum);
+		}
+	}
+
+	free(window);
+
+	return EXIT_SUCCESS;
+}
+
+uint32_t kernel_blur_precision()
+{
+	static uint32_t precision = []
+	{
+		const char *env = getenv("IMG_BLUR_PRECISION");
+
+		if(env != NULL && strcmp(env, "integer") == 0)
+			return (uint32_t)BLUR_PRECISION_INTEGER;
+
+		return (uint32_t)BLUR_PRECISION_FLOAT;
+	}();
+
+	return precision;
+}
+
+uint32_t kernel_chain_plan(const op_step *steps, uint32_t count, bool fuse_hsv, chain_pass *passes)
+{
+	uint32_t pass_count = 0;
+
+	if(count > OP_CHAIN_MAX)
+		return 0;
+
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t op = steps[i].op;
+
+		if(op < OP_GREY || op > OP_HSV_ADJUST)
+			return 0;
+
+		if((op == OP_CONVOLVE || op == OP_BOX_BLUR || op == OP_LUT || op == OP_HSV_ADJUST) && steps[i].args == NULL)
+			return 0;
+
+		if(op == OP_HSV && i != count - 1)
+			return 0;
+
+		bool point = op == OP_GREY || op == OP_LUT || op == OP_HSV_ADJUST || (op == OP_HSV && fuse_hsv);
+
+		if(!point || pass_count == 0)
+		{
+			passes[pass_count].op = point ? 0 : op;
+			passes[pass_count].args = point ? NULL : steps[i].args;
+			passes[pass_count].fused_count = 0;
+			++pass_count;
+		}
+
+		if(point)
+		{
+			chain_pass &pass = passes[pass_count - 1];
+			op_step *last = pass.fused_count > 0 ? &pass.fused[pass.fused_count - 1] : NULL;
+
+			/* A table after a table only needs one lookup, the composed table is kept in the pass. */
+			if(op == OP_LUT && last != NULL && last->op == OP_LUT)
+			{
+				kernel_lut_compose((const point_lut *)last->args, (const point_lut *)steps[i].args, &pass.lut);
+				last->args = &pass.lut;
+				continue;
+			}
+
+			pass.fused[pass.fused_count++] = steps[i];
+		}
+	}
+
+	return pass_count;
+}
+
+uint32_t kernel_chain_band_rows(uint32_t width)
+{
+	/* A band of 256 KiB fits into the L2 cache of most cpus. */
+	const uint32_t band_bytes = 256 * 1024;
+
+	return max(band_bytes / (uint32_t)(sizeof(uint32_t) * max(width, 1u)), 16u);
+}
+
+int kernel_chain_pass(uint32_t width, uint32_t height, const chain_pass &pass, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	switch(pass.op)
+	{
+		case 0:
+			/* Only point operations, in and out are the same buffer. */
+			break;
+		case OP_GREY:
+			kernel_grey(width, height, in, out, row_begin, row_end);
+			break;
+		case OP_HSV:
+			kernel_hsv(width, height, in, (uint8_t *)out, row_begin, row_end);
+			break;
+		case OP_EMBOSS:
+			kernel_emboss(width, height, in, out, row_begin, row_end);
+			break;
+		case OP_BLUR:
+		{
+			int success = kernel_blur_precision() == BLUR_PRECISION_INTEGER
+				? kernel_blur_separable_integer(width, height, in, out, row_begin, row_end)
+				: kernel_blur_separable(width, height, in, out, row_begin, row_end);
+
+			if(success != EXIT_SUCCESS)
+				return EXIT_FAILURE;
+
+			break;
+		}
+		case OP_CONVOLVE:
+			if(kernel_convolve(width, height, (const convolution_filter *)pass.args, in, out, row_begin, row_end) != EXIT_SUCCESS)
+				return EXIT_FAILURE;
+
+			break;
+		default:
+			return EXIT_FAILURE;
+	}
+
+	/* The rows of the band were just written and are still in the cache. */
+	for(uint32_t i = 0; i < pass.fused_count; ++i)
+	{
+		switch(pass.fused[i].op)
+		{
+			case OP_GREY:
+				kernel_grey(width, height, out, out, row_begin, row_end);
+				break;
+			case OP_LUT:
+				kernel_lut(width, height, (const point_lut *)pass.fused[i].args, out, out, row_begin, row_end);
+				break;
+			case OP_HSV_ADJUST:
+				kernel_hsv_adjust(width, height, (const hsv_adjust *)pass.fused[i].args, out, out, row_begin, row_end);
+				break;
+			default:
+				kernel_hsv(width, height, out, (uint8_t *)out, row_begin, row_end);
+				break;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Returns the number of passes from first on which can run on planar images:
+ * blur and emboss passes where only the last one may have point operations.
+ */
+static uint32_t chain_planar_length(const chain_pass *passes, uint32_t first, uint32_t pass_count)
+{
+	uint32_t length = 0;
+
+	for(uint32_t i = first; i < pass_count; ++i)
+	{
+		if(passes[i].op != OP_BLUR && passes[i].op != OP_EMBOSS)
+			break;
+
+		++length;
+
+		if(passes[i].fused_count > 0)
+			break;
+	}
+
+	return length;
+}
+
+/*
+ * Runs the passes [first, first + length) on planar copies of in and writes
+ * the packed result with the point operations of the last pass to out.
+ */
+static int chain_planar_run(uint32_t width, uint32_t height, const chain_pass *passes, uint32_t first, uint32_t length, const uint32_t *in, uint32_t *out, planar_image *planes, uint32_t band_rows, const range_runner &run)
+{
+	planar_image *source = &planes[0], *target = &planes[1];
+
+	run(height, band_rows, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		planar_unpack(in, source, row_begin, row_end);
+		return EXIT_SUCCESS;
+	});
+
+	for(uint32_t i = first; i < first + length; ++i)
+	{
+		int success = run(height, band_rows, [&](uint32_t row_begin, uint32_t row_end)
+		{
+			if(passes[i].op == OP_EMBOSS)
+			{
+				planar_emboss(source, target, row_begin, row_end);
+				return EXIT_SUCCESS;
+			}
+
+			return planar_blur(source, target, row_begin, row_end);
+		});
+
+		if(success != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+
+		swap(source, target);
+	}
+
+	chain_pass point = passes[first + length - 1];
+	point.op = 0;
+
+	return run(height, band_rows, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		planar_pack(source, out, row_begin, row_end);
+		return kernel_chain_pass(width, height, point, out, out, row_begin, row_end);
+	});
+}
+
+int kernel_chain_run(uint32_t width, uint32_t height, const chain_pass *passes, uint32_t pass_count, uint32_t *data, uint32_t *scratch, uint32_t band_rows, const range_runner &run)
+{
+	planar_image planes[2];
+	bool planar = false;
+
+	uint32_t *in = data, *out = scratch;
+	int success = EXIT_SUCCESS;
+
+	for(uint32_t i = 0; i < pass_count && success == EXIT_SUCCESS; )
+	{
+		uint32_t length = chain_planar_length(passes, i, pass_count);
+
+		/* A single filter is faster on the packed image than with the conversions. */
+		if(length >= 2 && !planar)
+		{
+			planar = planar_alloc(&planes[0], width, height) == EXIT_SUCCESS;
+
+			if(planar && planar_alloc(&planes[1], width, height) != EXIT_SUCCESS)
+			{
+				planar_free(&planes[0]);
+				planar = false;
+			}
+		}
+
+		if(length >= 2 && planar)
+		{
+			success = chain_planar_run(width, height, passes, i, length, in, out, planes, band_rows, run);
+			swap(in, out);
+			i += length;
+			continue;
+		}
+
+		if(passes[i].op == OP_BOX_BLUR)
+		{
+			/* The vertical box works on column strips, so the blur is not split into bands of rows. */
+			chain_pass point = passes[i];
+			point.op = 0;
+
+			success = kernel_box_blur(width, height, (const box_blur *)passes[i].args, in, in, out, run);
+
+			if(success == EXIT_SUCCESS && point.fused_count > 0)
+			{
+				success = run(height, band_rows, [&](uint32_t row_begin, uint32_t row_end)
+				{
+					return kernel_chain_pass(width, height, point, in, in, row_begin, row_end);
+				});
+			}
+
+			++i;
+			continue;
+		}
+
+		/* Passes with point operations only work in place. */
+		uint32_t *target = passes[i].op == 0 ? in : out;
+
+		success = run(height, band_rows, [&](uint32_t row_begin, uint32_t row_end)
+		{
+			return kernel_chain_pass(width, height, passes[i], in, target, row_begin, row_end);
+		});
+
+		/* Hsv leaves the last quarter of the image untouched like the in place operation. */
+		if(passes[i].op == OP_HSV)
+			memcpy((uint8_t *)out + (size_t)height * width * 3, (uint8_t *)in + (size_t)height * width * 3, (size_t)height * width);
+
+		if(target == out)
+			swap(in, out);
+
+		++i;
+	}
+
+	if(planar)
+	{
+		planar_free(&planes[0]);
+		planar_free(&planes[1]);
+	}
+
+	if(success == EXIT_SUCCESS && in != data)
+		memcpy(data, in, sizeof(uint32_t) * height * width);
+
+	return success;
+}
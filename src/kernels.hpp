@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <functional>
+#include "img_operations.hpp"
+
+/*
+ * Row based CPU kernels shared by the CPU backends.
+ * Every kernel processes the rows [row_begin, row_end) of the image
+ * and reads the whole input image if it needs neighbouring pixels.
+ * The input and output buffers must not overlap unless stated otherwise.
+ */
+
+/*
+ * Greyscales the rows. The input may be the output buffer.
+ */
+extern void kernel_grey(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Converts the rows to hsv. The output has three bytes per pixel
+ * and is addressed like the input (pixel index * 3).
+ * The output may be the input buffer if all rows are processed in one call.
+ */
+extern void kernel_hsv(uint32_t width, uint32_t height, const uint32_t *in, uint8_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Converts the rows to hsv, applies the adjustments and converts them back
+ * to rgba in one pass. The input may be the output buffer.
+ */
+extern void kernel_hsv_adjust(uint32_t width, uint32_t height, const hsv_adjust *adjust, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Replaces the channels of the rows with the values of the tables.
+ * The input may be the output buffer.
+ */
+extern void kernel_lut(uint32_t width, uint32_t height, const point_lut *lut, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Writes the table which applies first and then second to out.
+ * Out may be one of the inputs.
+ */
+extern void kernel_lut_compose(const point_lut *first, const point_lut *second, point_lut *out);
+
+/*
+ * Applies the emboss filter to one row. Every pixel only depends on itself and
+ * its top left neighbour, so the rows are independent of each other.
+ * top is the row above or the row itself for the first row of the image.
+ * The output may be the row but must not overlap top.
+ */
+extern void kernel_emboss_row(uint32_t width, const uint32_t *row, const uint32_t *top, uint32_t *out);
+
+/*
+ * Applies the emboss filter to the rows.
+ */
+extern void kernel_emboss(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Applies the emboss filter to the rows in place. The rows are processed bottom up,
+ * so only the row above row_begin has to be saved before: top is a copy of that row
+ * (of the row itself if row_begin is zero). Bands with their own copy can run in parallel.
+ */
+extern void kernel_emboss_in_place(uint32_t width, uint32_t *data, const uint32_t *top, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Applies the 5x5 gaussian blur filter to the rows.
+ */
+extern void kernel_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Applies the same filter as kernel_blur as a horizontal and a vertical pass.
+ * Only a rolling window of five rows is buffered, so the input may be the output
+ * buffer if all rows of the image are processed in one call.
+ * Returns EXIT_FAILURE if the window could not be allocated.
+ */
+extern int kernel_blur_separable(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Integer version of kernel_blur_separable. The four channels of a pixel
+ * are summed in 16 bit lanes of one 64 bit integer and divided by a shift.
+ * The result is identical to the float version.
+ */
+extern int kernel_blur_separable_integer(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/* Arithmetic used by the blur filter. */
+#define BLUR_PRECISION_FLOAT 0
+#define BLUR_PRECISION_INTEGER 1
+
+/*
+ * Returns the blur arithmetic selected by the environment variable
+ * IMG_BLUR_PRECISION, which is either float (default) or integer.
+ */
+extern uint32_t kernel_blur_precision();
+
+/*
+ * One pass of an operation chain: an operation which reads the input image
+ * followed by point operations which are applied to the output rows
+ * while they are still in the cache. If op is zero the pass only consists of
+ * point operations which are applied in place to the input image.
+ */
+struct chain_pass
+{
+	uint32_t op;
+	const void *args;
+	op_step fused[OP_CHAIN_MAX];
+	uint32_t fused_count;
+	point_lut lut;
+};
+
+/*
+ * Splits the operations of img_operations.hpp into passes.
+ * Hsv is only fused if fuse_hsv is set, because it moves the pixels of
+ * earlier rows and needs the rows to be processed in order.
+ * Consecutive lookup tables of a pass are composed into the table of the pass,
+ * so the passes must stay where they are while the chain runs.
+ * Returns the number of passes or zero if the chain is invalid.
+ */
+extern uint32_t kernel_chain_plan(const op_step *steps, uint32_t count, bool fuse_hsv, chain_pass *passes);
+
+/*
+ * Number of rows per band which keeps a band of the output in the cache.
+ */
+extern uint32_t kernel_chain_band_rows(uint32_t width);
+
+/*
+ * Runs a pass on the rows. Returns EXIT_FAILURE if an operation failed.
+ */
+extern int kernel_chain_pass(uint32_t width, uint32_t height, const chain_pass &pass, const uint32_t *in, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Runs the task on ranges [begin, end) of at most grain items which cover [0, count)
+ * and returns EXIT_FAILURE if any range failed. The backends decide whether the
+ * ranges run one after another or on several threads.
+ */
+typedef std::function<int(uint32_t begin, uint32_t end)> range_task;
+typedef std::function<int(uint32_t count, uint32_t grain, const range_task &task)> range_runner;
+
+/*
+ * Runs the passes on bands of band_rows rows and leaves the result in data.
+ * Runs of blur and emboss passes without point operations in between
+ * are computed on a planar copy of the image, see planar.hpp.
+ */
+extern int kernel_chain_run(uint32_t width, uint32_t height, const chain_pass *passes, uint32_t pass_count, uint32_t *data, uint32_t *scratch, uint32_t band_rows, const range_runner &run);
@@ -35,10 +35,21 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <stdio.h> /* file handling */
 #endif /* LODEPNG_COMPILE_DISK */
 
+#ifdef LODEPNG_COMPILE_MMAP
+#include <fcntl.h> /* open */
+#include <sys/mman.h> /* mmap, madvise */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h> /* close */
+#endif /* LODEPNG_COMPILE_MMAP */
+
 #ifdef LODEPNG_COMPILE_ALLOCATORS
 #include <stdlib.h> /* allocations */
 #endif /* LODEPNG_COMPILE_ALLOCATORS */
 
+#ifdef LODEPNG_COMPILE_SIMD
+#include <immintrin.h> /* SSE2 and AVX2 intrinsics */
+#endif /* LODEPNG_COMPILE_SIMD */
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -395,6 +406,51 @@ unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const
   return 0;
 }
 
+#ifdef LODEPNG_COMPILE_MMAP
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, const char* filename) {
+  struct stat info;
+  void* mapping;
+  size_t size;
+  int fd;
+
+  *out = 0;
+  *outsize = 0;
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) return 78;
+
+  /*only regular files have a size and can be mapped*/
+  if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size < 0 ||
+     (off_t)(size_t)info.st_size != info.st_size) {
+    close(fd);
+    return 78;
+  }
+
+  size = (size_t)info.st_size;
+  if(size == 0) {
+    close(fd);
+    return 0; /*mmap can't map empty files, the empty buffer is still a valid result*/
+  }
+
+  mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); /*the mapping stays valid after closing the file*/
+  if(mapping == MAP_FAILED) return 78;
+
+#ifdef MADV_SEQUENTIAL /*not declared in strict ANSI C mode*/
+  /*the decoder reads the chunks front to back, only a hint so the result is ignored*/
+  (void)madvise(mapping, size, MADV_SEQUENTIAL);
+#endif /*MADV_SEQUENTIAL*/
+
+  *out = (const unsigned char*)mapping;
+  *outsize = size;
+  return 0;
+}
+
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize) {
+  if(buffer) munmap((void*)buffer, buffersize);
+}
+#endif /*LODEPNG_COMPILE_MMAP*/
+
 #endif /*LODEPNG_COMPILE_DISK*/
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -1258,10 +1314,296 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   return error;
 }
 
+/*
+Optional receiver of the inflated data while inflating. flush is called whenever out holds at
+least threshold bytes, and once more with final set after the last block. It may remove bytes
+from the front of out, but must keep the last 32768 bytes since later matches can refer to them.
+*/
+typedef struct InflateSink {
+  unsigned (*flush)(ucvector* out, struct InflateSink* sink, unsigned final);
+  size_t threshold;
+  size_t removed; /*amount of bytes removed from out by flush so far*/
+  unsigned adler; /*adler32 of the removed bytes, must be updated by flush*/
+} InflateSink;
+
+/*
+Fast path of inflateHuffmanBlock, used while enough input and output space is left that no
+symbol needs bounds checks. The bits are kept in a buffer of the machine word size, which is
+refilled with one unaligned load per symbol, and the symbols are decoded with tables that
+already hold the base and extra bits of lengths and distances. Where two short literal codes
+fit in the first table bits, one lookup gives both literals.
+*/
+
+/*bits of the first table of the literal/length and the distance codes, longer codes need a subtable*/
+#define FAST_LL_BITS 11u
+#define FAST_D_BITS 8u
+
+/*kinds of table entries*/
+#define FAST_LITERAL 0u /*a: the literal*/
+#define FAST_LITERAL2 1u /*a: the first literal, b: the second literal*/
+#define FAST_LENGTH 2u /*length or distance, a: extra bits, b: base*/
+#define FAST_END 3u
+#define FAST_SUBTABLE 4u /*a: log2 of the subtable size, b: index of the subtable*/
+#define FAST_ERROR 5u /*a: the error code*/
+
+/*a table entry: the amount of code bits to consume, the kind and the two values a and b*/
+#define FAST_ENTRY(bits, kind, a, b) ((unsigned)(bits) | ((unsigned)(kind) << 5u) | ((unsigned)(a) << 8u) | ((unsigned)(b) << 16u))
+#define FAST_BITS(entry) ((entry) & 31u)
+#define FAST_KIND(entry) (((entry) >> 5u) & 7u)
+#define FAST_A(entry) (((entry) >> 8u) & 255u)
+#define FAST_B(entry) ((entry) >> 16u)
+
+/*
+Bytes that must be left after the read position, enough for the refills of one symbol even with a
+32-bit bit buffer, and bytes that must be allocated after the write position, for the longest match
+plus the overshoot of the word copies.
+*/
+#define FAST_IN_MARGIN (4u * sizeof(size_t))
+#define FAST_OUT_MARGIN (258u + 2u * sizeof(size_t))
+
+/*the entry of a symbol without its code bits, for the literal/length or the distance alphabet*/
+static unsigned fastSymbolEntry(unsigned symbol, unsigned distance) {
+  if(distance) {
+    if(symbol > 29) return FAST_ENTRY(0, FAST_ERROR, 18, 0); /*error: invalid distance code (30-31 are never used)*/
+    return FAST_ENTRY(0, FAST_LENGTH, DISTANCEEXTRA[symbol], DISTANCEBASE[symbol]);
+  }
+  if(symbol <= 255) return FAST_ENTRY(0, FAST_LITERAL, symbol, 0);
+  if(symbol == 256) return FAST_ENTRY(0, FAST_END, 0, 0);
+  if(symbol <= LAST_LENGTH_CODE_INDEX) {
+    return FAST_ENTRY(0, FAST_LENGTH, LENGTHEXTRA[symbol - FIRST_LENGTH_CODE_INDEX],
+                      LENGTHBASE[symbol - FIRST_LENGTH_CODE_INDEX]);
+  }
+  return FAST_ENTRY(0, FAST_ERROR, 16, 0); /*error: tried to read disallowed huffman symbol*/
+}
+
+/*makes the table of a tree made by HuffmanTree_makeFromLengths, which already rejected invalid trees*/
+static unsigned fastTableMake(unsigned** table, const HuffmanTree* tree, unsigned rootbits, unsigned distance) {
+  unsigned rootsize = 1u << rootbits;
+  unsigned mask = rootsize - 1u;
+  unsigned maxlens[1u << FAST_LL_BITS];
+  unsigned i, j, size = rootsize;
+
+  /*the longest code of each first table entry determines the size of its subtable*/
+  for(i = 0; i != rootsize; ++i) maxlens[i] = 0;
+  for(i = 0; i != tree->numcodes; ++i) {
+    unsigned l = tree->lengths[i];
+    if(l > rootbits) {
+      unsigned index = reverseBits(tree->codes[i] >> (l - rootbits), rootbits);
+      if(maxlens[index] < l) maxlens[index] = l;
+    }
+  }
+  for(i = 0; i != rootsize; ++i) {
+    if(maxlens[i]) size += 1u << (maxlens[i] - rootbits);
+  }
+
+  *table = (unsigned*)lodepng_malloc(size * sizeof(unsigned));
+  if(!*table) return 83; /*alloc fail*/
+
+  /*entries not used by any code only remain in trees with less than 2 symbols*/
+  for(i = 0; i != size; ++i) (*table)[i] = FAST_ENTRY(1, FAST_ERROR, 16, 0);
+  size = rootsize;
+  for(i = 0; i != rootsize; ++i) {
+    if(maxlens[i]) {
+      (*table)[i] = FAST_ENTRY(rootbits, FAST_SUBTABLE, maxlens[i] - rootbits, size);
+      size += 1u << (maxlens[i] - rootbits);
+    }
+  }
+
+  for(i = 0; i != tree->numcodes; ++i) {
+    unsigned l = tree->lengths[i];
+    /*reverse bits, because the huffman bits are given in MSB first order but the bit reader reads LSB first*/
+    unsigned reverse = reverseBits(tree->codes[i], l);
+    unsigned entry = fastSymbolEntry(i, distance);
+    if(l == 0) continue;
+    if(l <= rootbits) {
+      for(j = 0; j < (1u << (rootbits - l)); ++j) (*table)[reverse | (j << l)] = entry | l;
+    } else {
+      unsigned subtable = (*table)[reverse & mask];
+      unsigned bits = l - rootbits;
+      for(j = 0; j < (1u << (FAST_A(subtable) - bits)); ++j) {
+        (*table)[FAST_B(subtable) + ((reverse >> rootbits) | (j << bits))] = entry | bits;
+      }
+    }
+  }
+
+  if(!distance) {
+    /*combine a literal with a second literal whose code fits in the remaining bits of the index.
+    The index of the second code is smaller than the index itself, so going down reads it unchanged.*/
+    for(i = rootsize; i-- != 0;) {
+      unsigned first = (*table)[i], second;
+      if(FAST_KIND(first) != FAST_LITERAL || FAST_BITS(first) >= rootbits) continue;
+      second = (*table)[i >> FAST_BITS(first)];
+      if(FAST_KIND(second) != FAST_LITERAL || FAST_BITS(second) > rootbits - FAST_BITS(first)) continue;
+      (*table)[i] = FAST_ENTRY(FAST_BITS(first) + FAST_BITS(second), FAST_LITERAL2, FAST_A(first), FAST_A(second));
+    }
+  }
+  return 0;
+}
+
+/*the word of the machine size at the bytes, the first byte in the lowest bits*/
+static LODEPNG_INLINE size_t fastReadWord(const unsigned char* in) {
+  size_t result = 0;
+  unsigned endian = 1u;
+  unsigned i;
+  if(*(const unsigned char*)&endian) {
+    /*little endian, the compiler turns this into a single load*/
+    lodepng_memcpy(&result, in, sizeof(result));
+    return result;
+  }
+  for(i = 0; i != sizeof(size_t); ++i) result |= (size_t)in[i] << (8u * i);
+  return result;
+}
+
+/*copies one word of the machine size, the bytes may be unaligned*/
+static LODEPNG_INLINE void fastCopyWord(unsigned char* dst, const unsigned char* src) {
+  size_t word;
+  lodepng_memcpy(&word, src, sizeof(word));
+  lodepng_memcpy(dst, &word, sizeof(word));
+}
+
+/*fills the bit buffer with whole bytes, afterwards it holds at least 8 * sizeof(size_t) - 8 bits*/
+#define FAST_REFILL() {\
+  size_t bytes = (8u * sizeof(size_t) - 1u - bitsleft) >> 3u;\
+  bitbuf |= fastReadWord(in) << bitsleft;\
+  in += bytes;\
+  bitsleft += (unsigned)bytes << 3u;\
+}
+
+#define FAST_CONSUME(n) { bitbuf >>= (n); bitsleft -= (n); }
+
+/*decodes a literal/length code, the bit buffer must hold at least 15 bits*/
+#define FAST_DECODE_LL(entry) {\
+  entry = table_ll[bitbuf & ((1u << FAST_LL_BITS) - 1u)];\
+  if(FAST_KIND(entry) == FAST_SUBTABLE) {\
+    FAST_CONSUME(FAST_LL_BITS);\
+    entry = table_ll[FAST_B(entry) + (bitbuf & ((1u << FAST_A(entry)) - 1u))];\
+  }\
+  FAST_CONSUME(FAST_BITS(entry));\
+}
+
+/*decodes symbols of the block until the end code or the margins are reached, done tells which one*/
+static unsigned inflateHuffmanFast(ucvector* out, LodePNGBitReader* reader, const HuffmanTree* tree_ll,
+                                   const HuffmanTree* tree_d, InflateSink* sink, unsigned* done) {
+  unsigned error = 0;
+  unsigned* table_ll = 0;
+  unsigned* table_d = 0;
+  const unsigned char* in = reader->data + (reader->bp >> 3u);
+  const unsigned char* inlimit;
+  unsigned char* data = out->data;
+  size_t pos = out->size;
+  size_t poslimit = 0; /*the output margin or the sink need attention from here on*/
+  size_t flushsize = sink ? sink->threshold : (size_t)(-1);
+  size_t bitbuf = 0;
+  unsigned bitsleft = 0;
+
+  *done = 0;
+  /*short blocks at the end of the stream are not worth making the tables*/
+  if(reader->size - (reader->bp >> 3u) < 2u * FAST_IN_MARGIN) return 0;
+  inlimit = reader->data + reader->size - FAST_IN_MARGIN;
+
+  error = fastTableMake(&table_ll, tree_ll, FAST_LL_BITS, 0);
+  if(!error) error = fastTableMake(&table_d, tree_d, FAST_D_BITS, 1);
+
+  if(!error) {
+    FAST_REFILL();
+    FAST_CONSUME(reader->bp & 7u);
+  }
+
+  while(!error && in < inlimit) {
+    unsigned entry;
+
+    if(pos >= poslimit) {
+      if(pos >= flushsize) {
+        out->size = pos;
+        error = sink->flush(out, sink, 0);
+        if(error) break;
+        pos = out->size;
+        flushsize = sink->threshold;
+      }
+      if(pos + FAST_OUT_MARGIN > out->allocsize) {
+        if(!ucvector_resize(out, pos + FAST_OUT_MARGIN)) ERROR_BREAK(83); /*alloc fail*/
+      }
+      data = out->data;
+      poslimit = LODEPNG_MIN(out->allocsize - FAST_OUT_MARGIN + 1u, flushsize);
+    }
+
+    FAST_REFILL();
+    FAST_DECODE_LL(entry);
+
+    /*a 64-bit buffer has the bits for another literal/length code after the literals*/
+    if(sizeof(size_t) >= 8 && FAST_KIND(entry) <= FAST_LITERAL2) {
+      data[pos] = (unsigned char)FAST_A(entry);
+      data[pos + 1] = (unsigned char)FAST_B(entry);
+      pos += 1u + FAST_KIND(entry);
+      FAST_DECODE_LL(entry);
+    }
+
+    if(FAST_KIND(entry) == FAST_LITERAL) {
+      data[pos++] = (unsigned char)FAST_A(entry);
+    } else if(FAST_KIND(entry) == FAST_LITERAL2) {
+      data[pos] = (unsigned char)FAST_A(entry);
+      data[pos + 1] = (unsigned char)FAST_B(entry);
+      pos += 2;
+    } else if(FAST_KIND(entry) == FAST_LENGTH) {
+      size_t length, distance;
+      unsigned char* dst;
+      const unsigned char* src;
+
+      length = FAST_B(entry) + (bitbuf & ((1u << FAST_A(entry)) - 1u));
+      FAST_CONSUME(FAST_A(entry));
+
+      /*a 64-bit buffer still holds the bits of the distance, a 32-bit buffer may need more*/
+      if(bitsleft < 15u) FAST_REFILL();
+      entry = table_d[bitbuf & ((1u << FAST_D_BITS) - 1u)];
+      if(FAST_KIND(entry) == FAST_SUBTABLE) {
+        FAST_CONSUME(FAST_D_BITS);
+        entry = table_d[FAST_B(entry) + (bitbuf & ((1u << FAST_A(entry)) - 1u))];
+      }
+      if(FAST_KIND(entry) != FAST_LENGTH) ERROR_BREAK(FAST_A(entry));
+      FAST_CONSUME(FAST_BITS(entry));
+      if(bitsleft < 13u) FAST_REFILL();
+      distance = FAST_B(entry) + (bitbuf & ((1u << FAST_A(entry)) - 1u));
+      FAST_CONSUME(FAST_A(entry));
+
+      if(distance > pos) ERROR_BREAK(52); /*too long backward distance*/
+      dst = data + pos;
+      src = dst - distance;
+      pos += length;
+      if(distance >= sizeof(size_t)) {
+        /*whole words, the last one may write past the match into the margin*/
+        do {
+          fastCopyWord(dst, src);
+          dst += sizeof(size_t);
+          src += sizeof(size_t);
+        } while(dst < data + pos);
+      } else if(distance == 1) {
+        lodepng_memset(dst, *src, length);
+      } else {
+        /*the match overlaps itself within a word, copy byte by byte to repeat the pattern*/
+        size_t i;
+        for(i = 0; i != length; ++i) dst[i] = src[i];
+      }
+    } else if(FAST_KIND(entry) == FAST_END) {
+      *done = 1;
+      break;
+    } else {
+      ERROR_BREAK(FAST_A(entry));
+    }
+  }
+
+  out->size = pos;
+  /*give back the bits which were read ahead, the slow path continues from there*/
+  if(table_ll && table_d) reader->bp = (size_t)(in - reader->data) * 8u - bitsleft;
+  lodepng_free(table_ll);
+  lodepng_free(table_d);
+  return error;
+}
+
 /*inflate a block with dynamic of fixed Huffman tree. btype must be 1 or 2.*/
 static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
-                                    unsigned btype) {
-  unsigned error = 0;
+                                    unsigned btype, InflateSink* sink) {
+  unsigned error = 0, done = 0;
+  size_t flushsize;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
 
@@ -1271,7 +1613,12 @@ static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
   if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
   else /*if(btype == 2)*/ error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
 
-  while(!error) /*decode all symbols until end reached, breaks at end code*/ {
+  if(!error) error = inflateHuffmanFast(out, reader, &tree_ll, &tree_d, sink, &done);
+  /*without a sink the size never reaches this, so the check costs a single compare*/
+  flushsize = sink ? sink->threshold : (size_t)(-1);
+
+  /*decode the symbols close to the end of the input, breaks at end code*/
+  while(!error && !done) {
     /*code_ll is literal, length or end code*/
     unsigned code_ll;
     ensureBits25(reader, 20); /* up to 15 for the huffman symbol, up to 5 for the length extra bits */
@@ -1341,6 +1688,10 @@ static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
       /* TODO: revise error codes 10,11,50: the above comment is no longer valid */
       ERROR_BREAK(51); /*error, bit pointer jumps past memory*/
     }
+    if(out->size >= flushsize) {
+      error = sink->flush(out, sink, 0);
+      if(error) break;
+    }
   }
 
   HuffmanTree_cleanup(&tree_ll);
@@ -1383,7 +1734,7 @@ static unsigned inflateNoCompression(ucvector* out, LodePNGBitReader* reader,
 
 static unsigned lodepng_inflatev(ucvector* out,
                                  const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings) {
+                                 const LodePNGDecompressSettings* settings, InflateSink* sink) {
   unsigned BFINAL = 0;
   LodePNGBitReader reader;
   unsigned error = LodePNGBitReader_init(&reader, in, insize);
@@ -1398,19 +1749,51 @@ static unsigned lodepng_inflatev(ucvector* out,
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
     else if(BTYPE == 0) error = inflateNoCompression(out, &reader, settings); /*no compression*/
-    else error = inflateHuffmanBlock(out, &reader, BTYPE); /*compression, BTYPE 01 or 10*/
+    else error = inflateHuffmanBlock(out, &reader, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
     if(error) return error;
+    /*stored blocks are not flushed while copying, so check once more per block*/
+    if(sink && (BFINAL || out->size >= sink->threshold)) error = sink->flush(out, sink, BFINAL);
+    if(error) return error;
   }
 
   return error;
 }
 
+/*inflate the part [0, end) of a deflate stream which starts at a block and ends with the last byte of a
+block, such as the data between two full flushes. The data after end up to insize is readable but not part
+of the segment. final is set to whether the last block was the final block.*/
+static unsigned inflateSegment(ucvector* out, const unsigned char* in, size_t end, size_t insize,
+                               const LodePNGDecompressSettings* settings, unsigned* final) {
+  unsigned BFINAL = 0;
+  LodePNGBitReader reader;
+  unsigned error = LodePNGBitReader_init(&reader, in, insize);
+
+  if(error) return error;
+
+  while(!BFINAL && reader.bp < end * 8u) {
+    unsigned BTYPE;
+    if(!ensureBits9(&reader, 3)) return 52; /*error, bit pointer will jump past memory*/
+    BFINAL = readBits(&reader, 1);
+    BTYPE = readBits(&reader, 2);
+
+    if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, &reader, settings); /*no compression*/
+    else error = inflateHuffmanBlock(out, &reader, BTYPE, 0); /*compression, BTYPE 01 or 10*/
+
+    if(error) return error;
+  }
+
+  if((reader.bp + 7u) / 8u != end) return 52; /*the last block must end at the end of the segment*/
+  *final = BFINAL;
+  return 0;
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings) {
   ucvector v = ucvector_init(*out, *outsize);
-  unsigned error = lodepng_inflatev(&v, in, insize, settings);
+  unsigned error = lodepng_inflatev(&v, in, insize, settings, 0);
   *out = v.data;
   *outsize = v.size;
   return error;
@@ -1423,7 +1806,7 @@ static unsigned inflatev(ucvector* out, const unsigned char* in, size_t insize,
     out->allocsize = out->size;
     return error;
   } else {
-    return lodepng_inflatev(out, in, insize, settings);
+    return lodepng_inflatev(out, in, insize, settings, 0);
   }
 }
 
@@ -2061,18 +2444,40 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings) {
+/*insert the positions [start, end) in the hash chains without encoding them, so that the LZ77 encoding
+starting at end can refer back to them like to a preset dictionary. insize is the end of the data that
+will be encoded, matches may continue up to there.*/
+static void hashPrime(Hash* hash, const unsigned char* in, size_t start, size_t end, size_t insize,
+                      unsigned windowsize) {
+  size_t pos;
+  unsigned numzeros = 0;
+  for(pos = start; pos < end; ++pos) {
+    unsigned hashval = getHash(in, insize, pos);
+    if(hashval == 0) {
+      if(numzeros == 0) numzeros = countZeros(in, insize, pos);
+      else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
+    } else {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & (windowsize - 1), hashval, numzeros);
+  }
+}
+
+/*deflate the bytes [start, end) of in. If usedict is 1, the window before start is used as dictionary. If
+final is 0, the data is ended with a sync flush instead of a final block: an empty stored block which
+byte aligns the output, so that another deflate stream can be appended to it. Without dictionary this is
+a full flush, the next stream does not refer back either.*/
+static unsigned deflateRange(ucvector* out, const unsigned char* in, size_t start, size_t end,
+                             const LodePNGCompressSettings* settings, unsigned usedict, unsigned final) {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
+  size_t insize = end - start;
   Hash hash;
   LodePNGBitWriter writer;
 
   LodePNGBitWriter_init(&writer, out);
 
-  if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  if(settings->btype == 1) blocksize = insize;
   else /*if(settings->btype == 2)*/ {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
     blocksize = insize / 8u + 8;
@@ -2085,15 +2490,34 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 
   error = hash_init(&hash, settings->windowsize);
 
+  if(!error && usedict && start != 0 && settings->use_lz77) {
+    hashPrime(&hash, in, start > settings->windowsize ? start - settings->windowsize : 0, start, end,
+              settings->windowsize);
+  }
+
   if(!error) {
     for(i = 0; i != numdeflateblocks && !error; ++i) {
-      unsigned final = (i == numdeflateblocks - 1);
-      size_t start = i * blocksize;
-      size_t end = start + blocksize;
-      if(end > insize) end = insize;
+      unsigned last = (i == numdeflateblocks - 1);
+      size_t blockstart = start + i * blocksize;
+      size_t blockend = blockstart + blocksize;
+      if(blockend > end) blockend = end;
 
-      if(settings->btype == 1) error = deflateFixed(&writer, &hash, in, start, end, settings, final);
-      else if(settings->btype == 2) error = deflateDynamic(&writer, &hash, in, start, end, settings, final);
+      if(settings->btype == 1) error = deflateFixed(&writer, &hash, in, blockstart, blockend, settings, last && final);
+      else if(settings->btype == 2) error = deflateDynamic(&writer, &hash, in, blockstart, blockend, settings, last && final);
+    }
+  }
+
+  if(!error && !final) {
+    /*sync flush: BFINAL 0 and BTYPE 00, padding to the byte boundary, LEN 0 and NLEN 65535*/
+    size_t pos;
+    writeBits(&writer, 0, 3);
+    pos = out->size;
+    if(!ucvector_resize(out, pos + 4)) error = 83; /*alloc fail*/
+    else {
+      out->data[pos + 0] = 0;
+      out->data[pos + 1] = 0;
+      out->data[pos + 2] = 255;
+      out->data[pos + 3] = 255;
     }
   }
 
@@ -2102,6 +2526,13 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings) {
+  if(settings->btype > 2) return 61;
+  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
+  else return deflateRange(out, in, 0, insize, settings, 0, 1);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings) {
@@ -2153,15 +2584,32 @@ static unsigned adler32(const unsigned char* data, unsigned len) {
   return update_adler32(1u, data, len);
 }
 
+/*Return the adler32 of the concatenation of two byte sequences from their adler32 values, len2 is the
+length of the second sequence. Like zlib's adler32_combine: s1 of the second part counts len2 times
+into s2, and both parts counted the initial 1 of s1.*/
+static unsigned combine_adler32(unsigned adler1, unsigned adler2, size_t len2) {
+  unsigned rem = (unsigned)(len2 % 65521u);
+  unsigned s1 = adler1 & 0xffffu;
+  unsigned s2 = (rem * s1) % 65521u;
+  s1 += (adler2 & 0xffffu) + 65521u - 1u;
+  s2 += ((adler1 >> 16u) & 0xffffu) + ((adler2 >> 16u) & 0xffffu) + 65521u - rem;
+  if(s1 >= 65521u) s1 -= 65521u;
+  if(s1 >= 65521u) s1 -= 65521u;
+  if(s2 >= 65521u * 2u) s2 -= 65521u * 2u;
+  if(s2 >= 65521u) s2 -= 65521u;
+  return (s2 << 16u) | s1;
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*sink is optional, if given the custom inflate function of the settings is not used*/
 static unsigned lodepng_zlib_decompressv(ucvector* out,
                                          const unsigned char* in, size_t insize,
-                                         const LodePNGDecompressSettings* settings) {
+                                         const LodePNGDecompressSettings* settings, InflateSink* sink) {
   unsigned error = 0;
   unsigned CM, CINFO, FDICT;
 
@@ -2188,12 +2636,14 @@ static unsigned lodepng_zlib_decompressv(ucvector* out,
     return 26;
   }
 
-  error = inflatev(out, in + 2, insize - 2, settings);
+  if(sink) error = lodepng_inflatev(out, in + 2, insize - 2, settings, sink);
+  else error = inflatev(out, in + 2, insize - 2, settings);
   if(error) return error;
 
   if(!settings->ignore_adler32) {
     unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
-    unsigned checksum = adler32(out->data, (unsigned)(out->size));
+    unsigned checksum = sink ? update_adler32(sink->adler, out->data, (unsigned)(out->size))
+                             : adler32(out->data, (unsigned)(out->size));
     if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
   }
 
@@ -2204,7 +2654,7 @@ static unsigned lodepng_zlib_decompressv(ucvector* out,
 unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                  size_t insize, const LodePNGDecompressSettings* settings) {
   ucvector v = ucvector_init(*out, *outsize);
-  unsigned error = lodepng_zlib_decompressv(&v, in, insize, settings);
+  unsigned error = lodepng_zlib_decompressv(&v, in, insize, settings, 0);
   *out = v.data;
   *outsize = v.size;
   return error;
@@ -2223,7 +2673,7 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, size_t exp
       ucvector_resize(&v, *outsize + expected_size);
       v.size = *outsize;
     }
-    error = lodepng_zlib_decompressv(&v, in, insize, settings);
+    error = lodepng_zlib_decompressv(&v, in, insize, settings, 0);
     *out = v.data;
     *outsize = v.size;
     return error;
@@ -2234,14 +2684,104 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, size_t exp
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
-unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                               size_t insize, const LodePNGCompressSettings* settings) {
+/*the chunks of the input deflated by deflateChunks, each one is written by one task only*/
+typedef struct DeflateChunks {
+  const unsigned char* in;
+  size_t insize;
+  size_t chunksize;
+  unsigned usedict;
+  const LodePNGCompressSettings* settings;
+  ucvector* out; /*deflate data per chunk*/
+  unsigned* adler; /*adler32 per chunk*/
+} DeflateChunks;
+
+static unsigned deflateChunkTask(void* data, size_t index) {
+  DeflateChunks* chunks = (DeflateChunks*)data;
+  size_t start = index * chunks->chunksize;
+  size_t end = chunks->insize - start > chunks->chunksize ? start + chunks->chunksize : chunks->insize;
+  chunks->adler[index] = adler32(&chunks->in[start], (unsigned)(end - start));
+  return deflateRange(&chunks->out[index], chunks->in, start, end, chunks->settings, chunks->usedict,
+                      end == chunks->insize);
+}
+
+/*deflate the input as chunks of chunksize bytes, using settings->custom_parallel to run them. The chunks
+are joined with sync flushes (full flushes if usedict is 0), so the output is a single deflate stream, and
+their adler32 values are combined to the adler32 of the whole input. If ends is not null, it receives the
+size of the output after each chunk.*/
+static unsigned deflateChunks(unsigned char** out, size_t* outsize, unsigned* adler, size_t* ends,
+                              const unsigned char* in, size_t insize, size_t chunksize, unsigned usedict,
+                              const LodePNGCompressSettings* settings) {
+  unsigned error = 0;
+  size_t i, pos, numchunks = (insize + chunksize - 1) / chunksize;
+  DeflateChunks chunks;
+
+  chunks.in = in;
+  chunks.insize = insize;
+  chunks.chunksize = chunksize;
+  chunks.usedict = usedict;
+  chunks.settings = settings;
+  chunks.out = (ucvector*)lodepng_malloc(numchunks * sizeof(ucvector));
+  chunks.adler = (unsigned*)lodepng_malloc(numchunks * sizeof(unsigned));
+  if(!chunks.out || !chunks.adler) error = 83; /*alloc fail*/
+
+  if(!error) {
+    for(i = 0; i != numchunks; ++i) chunks.out[i] = ucvector_init(NULL, 0);
+    if(settings->custom_parallel) {
+      error = settings->custom_parallel(deflateChunkTask, &chunks, numchunks, settings);
+    } else {
+      for(i = 0; i != numchunks && !error; ++i) error = deflateChunkTask(&chunks, i);
+    }
+  }
+
+  if(!error) {
+    *outsize = 0;
+    for(i = 0; i != numchunks; ++i) *outsize += chunks.out[i].size;
+    *out = (unsigned char*)lodepng_malloc(*outsize);
+    if(!*out) error = 83; /*alloc fail*/
+  }
+
+  if(!error) {
+    *adler = chunks.adler[0];
+    for(i = 1; i != numchunks; ++i) {
+      size_t start = i * chunks.chunksize;
+      size_t length = insize - start > chunks.chunksize ? chunks.chunksize : insize - start;
+      *adler = combine_adler32(*adler, chunks.adler[i], length);
+    }
+    for(i = 0, pos = 0; i != numchunks; ++i) {
+      lodepng_memcpy(*out + pos, chunks.out[i].data, chunks.out[i].size);
+      pos += chunks.out[i].size;
+      if(ends) ends[i] = pos;
+    }
+  }
+
+  if(chunks.out) {
+    for(i = 0; i != numchunks; ++i) lodepng_free(chunks.out[i].data);
+  }
+  lodepng_free(chunks.out);
+  lodepng_free(chunks.adler);
+  return error;
+}
+
+/*zlib compress the input, as chunks of chunksize bytes if it's not 0 (see deflateChunks). If ends is not
+null, it receives the offset in out after the deflate data of each chunk.*/
+static unsigned zlibCompressChunks(unsigned char** out, size_t* outsize, size_t* ends,
+                                   const unsigned char* in, size_t insize, size_t chunksize, unsigned usedict,
+                                   const LodePNGCompressSettings* settings) {
   size_t i;
   unsigned error;
   unsigned char* deflatedata = 0;
   size_t deflatesize = 0;
+  unsigned ADLER32 = 0;
 
-  error = deflate(&deflatedata, &deflatesize, in, insize, settings);
+  if(chunksize) {
+    error = deflateChunks(&deflatedata, &deflatesize, &ADLER32, ends, in, insize, chunksize, usedict, settings);
+    if(!error && ends) {
+      for(i = 0; i != (insize + chunksize - 1) / chunksize; ++i) ends[i] += 2;
+    }
+  } else {
+    error = deflate(&deflatedata, &deflatesize, in, insize, settings);
+    if(!error) ADLER32 = adler32(in, (unsigned)insize);
+  }
 
   *out = NULL;
   *outsize = 0;
@@ -2252,7 +2792,6 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   }
 
   if(!error) {
-    unsigned ADLER32 = adler32(in, (unsigned)insize);
     /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
     unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
     unsigned FLEVEL = 0;
@@ -2271,6 +2810,14 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   return error;
 }
 
+unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                               size_t insize, const LodePNGCompressSettings* settings) {
+  /*the chunks are only used by the built in deflate, which compresses with btype 1 or 2*/
+  unsigned chunked = settings->chunksize && insize > settings->chunksize && !settings->custom_deflate &&
+                     (settings->btype == 1 || settings->btype == 2);
+  return zlibCompressChunks(out, outsize, 0, in, insize, chunked ? settings->chunksize : 0, 1, settings);
+}
+
 /* compress using the default or custom zlib function */
 static unsigned zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
                               size_t insize, const LodePNGCompressSettings* settings) {
@@ -2318,13 +2865,15 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->chunksize = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
+  settings->custom_parallel = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2337,10 +2886,11 @@ void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings) {
 
   settings->custom_zlib = 0;
   settings->custom_inflate = 0;
+  settings->custom_parallel = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0};
+const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0, 0};
 
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -3959,6 +4509,42 @@ static unsigned char paethPredictor(short a, short b, short c) {
   return (pc < pa) ? c : a;
 }
 
+#ifdef LODEPNG_COMPILE_SIMD
+/*
+The paeth predictor of 8 or 16 values at once, on 16-bit lanes so that the differences fit. Picks the same value
+as paethPredictor when pa, pb or pc are equal.
+*/
+__attribute__((target("sse2")))
+static __m128i paethPredictorSSE2(__m128i a, __m128i b, __m128i c) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i pa = _mm_sub_epi16(b, c);
+  __m128i pb = _mm_sub_epi16(a, c);
+  __m128i pc = _mm_add_epi16(pa, pb);
+  __m128i smallest, usea, useb;
+  pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+  pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+  pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+  smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+  usea = _mm_cmpeq_epi16(pa, smallest);
+  useb = _mm_andnot_si128(usea, _mm_cmpeq_epi16(pb, smallest));
+  return _mm_or_si128(_mm_or_si128(_mm_and_si128(usea, a), _mm_and_si128(useb, b)),
+                      _mm_andnot_si128(_mm_or_si128(usea, useb), c));
+}
+
+#ifdef LODEPNG_COMPILE_ENCODER
+/*only the encoder has a version with 32 bytes*/
+__attribute__((target("avx2")))
+static __m256i paethPredictorAVX2(__m256i a, __m256i b, __m256i c) {
+  __m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+  __m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+  __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(_mm256_sub_epi16(b, c), _mm256_sub_epi16(a, c)));
+  __m256i smallest = _mm256_min_epi16(pc, _mm256_min_epi16(pa, pb));
+  __m256i nearest = _mm256_blendv_epi8(c, b, _mm256_cmpeq_epi16(pb, smallest));
+  return _mm256_blendv_epi8(nearest, a, _mm256_cmpeq_epi16(pa, smallest));
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+#endif /*LODEPNG_COMPILE_SIMD*/
+
 /*shared values used by multiple Adam7 related functions*/
 
 static const unsigned ADAM7_IX[7] = { 0, 4, 0, 2, 0, 1, 0 }; /*x start values*/
@@ -4077,6 +4663,181 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#ifdef LODEPNG_COMPILE_SIMD
+/*
+The SSE2 and AVX2 versions of unfilterScanline. Like there, recon may be the same memory as scanline, or lie
+before it, so only the bytes of the result are stored and every input byte is loaded before it's overwritten.
+Up works on any pixel size. The other filters depend on the previous pixel, so Average and Paeth work on one
+pixel at a time for 3 and 4 byte pixels, with the channels side by side in a register. Sub adds up the pixels
+of a whole register as prefix sum.
+*/
+
+/*load 4 bytes into the lowest lane of a register*/
+__attribute__((target("sse2")))
+static __m128i loadPixelSSE2(const unsigned char* p) {
+  int v;
+  lodepng_memcpy(&v, p, 4);
+  return _mm_cvtsi32_si128(v);
+}
+
+/*store the lowest 3 or 4 bytes of a register*/
+__attribute__((target("sse2")))
+static void storePixelSSE2(unsigned char* p, __m128i x, size_t bytewidth) {
+  int v = _mm_cvtsi128_si32(x);
+  if(bytewidth == 4) {
+    lodepng_memcpy(p, &v, 4);
+  } else {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+  }
+}
+
+__attribute__((target("sse2")))
+static void unfilterUpSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length) {
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(scanline + i));
+    __m128i p = _mm_loadu_si128((const __m128i*)(precon + i));
+    _mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(s, p));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+__attribute__((target("avx2")))
+static void unfilterUpAVX2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length) {
+  size_t i = 0;
+  for(; i + 32 <= length; i += 32) {
+    __m256i s = _mm256_loadu_si256((const __m256i*)(scanline + i));
+    __m256i p = _mm256_loadu_si256((const __m256i*)(precon + i));
+    _mm256_storeu_si256((__m256i*)(recon + i), _mm256_add_epi8(s, p));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+/*Sub with 4 byte pixels: the prefix sum of the 4 pixels of a register plus the last pixel before them*/
+__attribute__((target("sse2")))
+static void unfilterSub4SSE2(unsigned char* recon, const unsigned char* scanline, size_t length) {
+  __m128i last = _mm_setzero_si128(); /*the last pixel in all 4 lanes*/
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi8(x, last);
+    _mm_storeu_si128((__m128i*)(recon + i), x);
+    last = _mm_shuffle_epi32(x, 0xff);
+  }
+  for(; i < 4 && i != length; ++i) recon[i] = scanline[i];
+  for(; i != length; ++i) recon[i] = scanline[i] + recon[i - 4];
+}
+
+/*the same with 8 pixels per register, the two 128-bit halves are summed separately and then joined*/
+__attribute__((target("avx2")))
+static void unfilterSub4AVX2(unsigned char* recon, const unsigned char* scanline, size_t length) {
+  __m256i last = _mm256_setzero_si256();
+  size_t i = 0;
+  for(; i + 32 <= length; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(scanline + i));
+    x = _mm256_add_epi8(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi8(x, _mm256_slli_si256(x, 8));
+    /*add the last pixel of the low half to the high half*/
+    x = _mm256_add_epi8(x, _mm256_permute2x128_si256(_mm256_shuffle_epi32(x, 0xff), x, 0x08));
+    x = _mm256_add_epi8(x, last);
+    _mm256_storeu_si256((__m256i*)(recon + i), x);
+    last = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+  }
+  for(; i < 4 && i != length; ++i) recon[i] = scanline[i];
+  for(; i != length; ++i) recon[i] = scanline[i] + recon[i - 4];
+}
+
+/*Sub with 3 byte pixels: 4 pixels in the lowest 12 bytes of a register*/
+__attribute__((target("sse2")))
+static void unfilterSub3SSE2(unsigned char* recon, const unsigned char* scanline, size_t length) {
+  const __m128i mask = _mm_cvtsi32_si128(0xffffff);
+  __m128i last = _mm_setzero_si128(); /*the last pixel repeated 4 times*/
+  size_t i = 0;
+  for(; i + 16 <= length; i += 12) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+    x = _mm_add_epi8(x, last);
+    _mm_storel_epi64((__m128i*)(recon + i), x);
+    storePixelSSE2(recon + i + 8, _mm_srli_si128(x, 8), 4);
+    last = _mm_and_si128(_mm_srli_si128(x, 9), mask);
+    last = _mm_or_si128(last, _mm_slli_si128(last, 3));
+    last = _mm_or_si128(last, _mm_slli_si128(last, 6));
+  }
+  for(; i < 3 && i != length; ++i) recon[i] = scanline[i];
+  for(; i != length; ++i) recon[i] = scanline[i] + recon[i - 3];
+}
+
+/*Average with 3 or 4 byte pixels, floor((a + b) / 2) is the rounded up average minus the lost lowest bit*/
+__attribute__((target("sse2")))
+static void unfilterAverageSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bytewidth, size_t length) {
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i a = _mm_setzero_si128(); /*the previous pixel of recon*/
+  size_t i = 0;
+  for(; i + 4 <= length; i += bytewidth) {
+    __m128i b = loadPixelSSE2(precon + i);
+    __m128i x = loadPixelSSE2(scanline + i);
+    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(x, avg);
+    storePixelSSE2(recon + i, a, bytewidth);
+  }
+  for(; i < bytewidth && i != length; ++i) recon[i] = scanline[i] + (precon[i] >> 1u);
+  for(; i != length; ++i) recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) >> 1u);
+}
+
+/*Paeth with 3 or 4 byte pixels, on 16-bit lanes*/
+__attribute__((target("sse2")))
+static void unfilterPaethSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                              size_t bytewidth, size_t length) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = zero; /*the previous pixel of recon*/
+  __m128i c = zero; /*the previous pixel of precon*/
+  size_t i = 0;
+  for(; i + 4 <= length; i += bytewidth) {
+    __m128i b = _mm_unpacklo_epi8(loadPixelSSE2(precon + i), zero);
+    __m128i x = _mm_unpacklo_epi8(loadPixelSSE2(scanline + i), zero);
+    /*the high bytes of the lanes are 0, so a byte add wraps like the scalar version*/
+    a = _mm_add_epi8(x, paethPredictorSSE2(a, b, c));
+    storePixelSSE2(recon + i, _mm_packus_epi16(a, a), bytewidth);
+    c = b;
+  }
+  for(; i < bytewidth && i != length; ++i) recon[i] = scanline[i] + precon[i];
+  for(; i != length; ++i) {
+    recon[i] = (scanline[i] + paethPredictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]));
+  }
+}
+
+/*unfilter the scanline with SSE2 or AVX2 if there is a version for the filter type and pixel size and the cpu
+supports it, returns 0 if not*/
+static unsigned unfilterScanlineSIMD(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length) {
+  if(!__builtin_cpu_supports("sse2")) return 0;
+  if(filterType == 1 && bytewidth == 4) {
+    if(__builtin_cpu_supports("avx2")) unfilterSub4AVX2(recon, scanline, length);
+    else unfilterSub4SSE2(recon, scanline, length);
+  } else if(filterType == 1 && bytewidth == 3) {
+    unfilterSub3SSE2(recon, scanline, length);
+  } else if(filterType == 2 && precon) {
+    if(__builtin_cpu_supports("avx2")) unfilterUpAVX2(recon, scanline, precon, length);
+    else unfilterUpSSE2(recon, scanline, precon, length);
+  } else if(filterType == 3 && precon && (bytewidth == 3 || bytewidth == 4)) {
+    unfilterAverageSSE2(recon, scanline, precon, bytewidth, length);
+  } else if(filterType == 4 && precon && (bytewidth == 3 || bytewidth == 4)) {
+    unfilterPaethSSE2(recon, scanline, precon, bytewidth, length);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+#endif /*LODEPNG_COMPILE_SIMD*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length) {
   /*
@@ -4089,6 +4850,9 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   */
 
   size_t i;
+#ifdef LODEPNG_COMPILE_SIMD
+  if(unfilterScanlineSIMD(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#endif /*LODEPNG_COMPILE_SIMD*/
   switch(filterType) {
     case 0:
       for(i = 0; i != length; ++i) recon[i] = scanline[i];
@@ -4717,16 +5481,14 @@ unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
 }
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize) {
+/*reads all chunks into the state and collects the data of the IDAT chunks in idat, which the
+caller must free, also when an error happened. If index is not null, it receives the data of
+a pdIX chunk with a valid CRC, or null if there is none*/
+static void decodeChunks(unsigned char** idat, size_t* idatsize, unsigned* w, unsigned* h,
+                         const unsigned char** index, size_t* indexsize, LodePNGState* state,
+                         const unsigned char* in, size_t insize) {
   unsigned char IEND = 0;
   const unsigned char* chunk;
-  unsigned char* idat; /*the data from idat chunks, zlib compressed*/
-  size_t idatsize = 0;
-  unsigned char* scanlines = 0;
-  size_t scanlines_size = 0, expected_size = 0;
-  size_t outsize = 0;
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4736,8 +5498,13 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
 
   /* safe output values in case error happens */
-  *out = 0;
+  *idat = 0;
+  *idatsize = 0;
   *w = *h = 0;
+  if(index) {
+    *index = 0;
+    *indexsize = 0;
+  }
 
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
@@ -4747,8 +5514,8 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   }
 
   /*the input filesize is a safe upper bound for the sum of idat chunks size*/
-  idat = (unsigned char*)lodepng_malloc(insize);
-  if(!idat) CERROR_RETURN(state->error, 83); /*alloc fail*/
+  *idat = (unsigned char*)lodepng_malloc(insize);
+  if(!*idat) CERROR_RETURN(state->error, 83); /*alloc fail*/
 
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
@@ -4783,10 +5550,10 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT")) {
       size_t newsize;
-      if(lodepng_addofl(idatsize, chunkLength, &newsize)) CERROR_BREAK(state->error, 95);
+      if(lodepng_addofl(*idatsize, chunkLength, &newsize)) CERROR_BREAK(state->error, 95);
       if(newsize > insize) CERROR_BREAK(state->error, 95);
-      lodepng_memcpy(idat + idatsize, data, chunkLength);
-      idatsize += chunkLength;
+      lodepng_memcpy(*idat + *idatsize, data, chunkLength);
+      *idatsize += chunkLength;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4848,6 +5615,13 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
       state->error = readChunk_iCCP(&state->info_png, &state->decoder.zlibsettings, data, chunkLength);
       if(state->error) break;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
+    } else if(lodepng_chunk_type_equals(chunk, "pdIX")) {
+      /*segment index written by lodepng, only a hint for decoding in parallel, so it's ignored if corrupted*/
+      if(index && (state->decoder.ignore_crc || !lodepng_chunk_check_crc(chunk))) {
+        *index = data;
+        *indexsize = chunkLength;
+      }
+      unknown = 1; /*the CRC is checked above*/
     } else /*it's not an implemented chunk type, so ignore it: skip over the data*/ {
       /*error: unknown critical chunk (5th bit of first byte of chunk type is 0)*/
       if(!state->decoder.ignore_critical && !lodepng_chunk_ancillary(chunk)) {
@@ -4874,6 +5648,147 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   if(state->info_png.color.colortype == LCT_PALETTE && !state->info_png.color.palette) {
     state->error = 106; /* error: PNG file must have PLTE chunk if color type is palette */
   }
+}
+
+/*whether the rows in the color mode can be handled as one continuous bit stream*/
+static unsigned rowsAreAligned(unsigned w, const LodePNGColorMode* mode) {
+  return ((size_t)w * lodepng_get_bpp(mode)) % 8u == 0;
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*the segments of an image with a pdIX chunk, each one is inflated and unfiltered by its own task*/
+typedef struct SegmentDecode {
+  const unsigned char* idat;
+  size_t idatsize;
+  const unsigned char* index; /*per segment the offset in idat and the first scanline, 4 bytes each*/
+  size_t numsegments;
+  unsigned h;
+  size_t linebytes; /*size of an unfiltered scanline*/
+  size_t bytewidth;
+  const LodePNGDecompressSettings* settings;
+  unsigned char* out;
+  unsigned* adler; /*adler32 per segment*/
+} SegmentDecode;
+
+static unsigned decodeSegmentTask(void* data, size_t index) {
+  SegmentDecode* d = (SegmentDecode*)data;
+  unsigned last = (index + 1 == d->numsegments);
+  size_t start = lodepng_read32bitInt(&d->index[index * 8]);
+  size_t end = last ? d->idatsize - 4 : lodepng_read32bitInt(&d->index[index * 8 + 8]);
+  unsigned y = lodepng_read32bitInt(&d->index[index * 8 + 4]);
+  unsigned yend = last ? d->h : lodepng_read32bitInt(&d->index[index * 8 + 12]);
+  size_t i, expected = (size_t)(yend - y) * (d->linebytes + 1u);
+  const unsigned char* prevline = 0;
+  unsigned final = 0;
+  unsigned error = 0;
+  ucvector scanlines = ucvector_init(NULL, 0);
+
+  /*reserve the memory to avoid intermediate reallocations*/
+  if(!ucvector_resize(&scanlines, expected)) error = 83; /*alloc fail*/
+  scanlines.size = 0;
+  if(!error) error = inflateSegment(&scanlines, d->idat + start, end - start, d->idatsize - start, d->settings, &final);
+  if(!error && (scanlines.size != expected || final != last)) error = 91;
+  /*the first scanline can't refer to the one above it, that one belongs to another segment*/
+  if(!error && y != 0 && scanlines.data[0] > 1) error = 36;
+
+  if(!error) {
+    d->adler[index] = adler32(scanlines.data, (unsigned)scanlines.size);
+    for(i = 0; i != yend - y && !error; ++i) {
+      unsigned char* line = &d->out[(y + i) * d->linebytes];
+      error = unfilterScanline(line, &scanlines.data[i * (d->linebytes + 1u) + 1u], prevline, d->bytewidth,
+                               scanlines.data[i * (d->linebytes + 1u)], d->linebytes);
+      prevline = line;
+    }
+  }
+
+  lodepng_free(scanlines.data);
+  return error;
+}
+
+/*decode the image data as the segments of the pdIX chunk index, with the custom_parallel function of the
+decoder. Returns an error if the image can't be decoded this way, the caller then decodes it in one stream,
+which also gives the right error for corrupted images.*/
+static unsigned decodeSegments(unsigned char** out, unsigned w, unsigned h, const LodePNGState* state,
+                               const unsigned char* idat, size_t idatsize,
+                               const unsigned char* index, size_t indexsize) {
+  const LodePNGDecompressSettings* settings = &state->decoder.zlibsettings;
+  unsigned error = 0;
+  unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+  size_t i;
+  SegmentDecode d;
+
+  *out = 0;
+  if(!settings->custom_parallel || settings->custom_zlib || settings->custom_inflate) return 1;
+  if(state->info_png.interlace_method != 0 || !rowsAreAligned(w, &state->info_png.color)) return 1;
+  if(indexsize % 8u != 0 || indexsize < 16 || idatsize < 6) return 1;
+  /*the zlib header, checked like lodepng_zlib_decompressv does*/
+  if((idat[0] * 256 + idat[1]) % 31 != 0 || (idat[0] & 15) != 8 || (idat[0] >> 4) > 7 || (idat[1] & 32)) return 1;
+
+  d.idat = idat;
+  d.idatsize = idatsize;
+  d.index = index;
+  d.numsegments = indexsize / 8u;
+  d.h = h;
+  d.linebytes = lodepng_get_raw_size_idat(w, 1, bpp) - 1u;
+  d.bytewidth = (bpp + 7u) / 8u;
+  d.settings = settings;
+
+  /*the segments must follow each other from the first deflate block and the first scanline*/
+  if(lodepng_read32bitInt(&index[0]) != 2 || lodepng_read32bitInt(&index[4]) != 0) return 1;
+  for(i = 1; i != d.numsegments; ++i) {
+    if(lodepng_read32bitInt(&index[i * 8]) <= lodepng_read32bitInt(&index[i * 8 - 8])) return 1;
+    if(lodepng_read32bitInt(&index[i * 8 + 4]) <= lodepng_read32bitInt(&index[i * 8 - 4])) return 1;
+  }
+  if(lodepng_read32bitInt(&index[indexsize - 8]) >= idatsize - 4) return 1;
+  if(lodepng_read32bitInt(&index[indexsize - 4]) >= h) return 1;
+
+  d.out = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(w, h, &state->info_png.color));
+  d.adler = (unsigned*)lodepng_malloc(d.numsegments * sizeof(unsigned));
+  if(!d.out || !d.adler) error = 83; /*alloc fail*/
+
+  if(!error) error = settings->custom_parallel(decodeSegmentTask, &d, d.numsegments, settings);
+
+  if(!error && !settings->ignore_adler32) {
+    unsigned adler = d.adler[0];
+    for(i = 1; i != d.numsegments; ++i) {
+      unsigned y = lodepng_read32bitInt(&index[i * 8 + 4]);
+      unsigned yend = i + 1 == d.numsegments ? h : lodepng_read32bitInt(&index[i * 8 + 12]);
+      adler = combine_adler32(adler, d.adler[i], (size_t)(yend - y) * (d.linebytes + 1u));
+    }
+    if(adler != lodepng_read32bitInt(&idat[idatsize - 4])) error = 58;
+  }
+
+  lodepng_free(d.adler);
+  if(error) lodepng_free(d.out);
+  else *out = d.out;
+  return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize) {
+  unsigned char* idat; /*the data from idat chunks, zlib compressed*/
+  size_t idatsize;
+  unsigned char* scanlines = 0;
+  size_t scanlines_size = 0, expected_size = 0;
+  size_t outsize = 0;
+
+  const unsigned char* index;
+  size_t indexsize;
+
+  /* safe output values in case error happens */
+  *out = 0;
+
+  decodeChunks(&idat, &idatsize, w, h, &index, &indexsize, state, in, insize);
+
+#ifdef LODEPNG_COMPILE_ZLIB
+  /*images with a segment index are decoded in parallel if possible, otherwise in one stream as usual*/
+  if(!state->error && index && !decodeSegments(out, *w, *h, state, idat, idatsize, index, indexsize)) {
+    lodepng_free(idat);
+    return;
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
 
   if(!state->error) {
     /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
@@ -4948,6 +5863,220 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*state of lodepng_decode_rows while inflating, the sink must be the first member*/
+typedef struct RowStream {
+  InflateSink sink;
+  const LodePNGColorMode* mode_png;
+  const LodePNGColorMode* mode_raw;
+  unsigned w, h;
+  unsigned y; /*first row of the current band*/
+  unsigned count; /*amount of rows in the current band*/
+  unsigned max_rows;
+  size_t bytewidth; /*as in unfilter*/
+  size_t linebytes; /*unfiltered scanline without the filter type byte*/
+  size_t rawbytes; /*row in the raw color type*/
+  size_t step; /*amount of inflated bytes between two flushes*/
+  size_t pos; /*position in the inflated data of the first scanline not unfiltered yet*/
+  unsigned char* band; /*the last row of the previous band followed by max_rows unfiltered rows*/
+  unsigned char* converted; /*the band in the raw color type, 0 if the color types are equal*/
+  LodePNGRowCallback callback;
+  void* user;
+} RowStream;
+
+static unsigned rowStreamEmit(RowStream* stream) {
+  const unsigned char* rows = &stream->band[stream->linebytes];
+  unsigned i;
+
+  if(stream->converted) {
+    if(rowsAreAligned(stream->w, stream->mode_png) && rowsAreAligned(stream->w, stream->mode_raw)) {
+      CERROR_TRY_RETURN(lodepng_convert(stream->converted, rows, stream->mode_raw, stream->mode_png,
+                                        stream->w, stream->count));
+    } else {
+      /*convert row by row, so that every row starts at a byte*/
+      for(i = 0; i != stream->count; ++i) {
+        CERROR_TRY_RETURN(lodepng_convert(&stream->converted[i * stream->rawbytes], &rows[i * stream->linebytes],
+                                          stream->mode_raw, stream->mode_png, stream->w, 1));
+      }
+    }
+    rows = stream->converted;
+  }
+
+  if(stream->callback(stream->user, rows, stream->y, stream->count)) return 109;
+
+  /*the last row of the band is the previous row of the first row of the next band*/
+  lodepng_memcpy(stream->band, &stream->band[stream->count * stream->linebytes], stream->linebytes);
+  stream->y += stream->count;
+  stream->count = 0;
+  return 0;
+}
+
+static unsigned rowStreamFlush(ucvector* out, InflateSink* sink, unsigned final) {
+  RowStream* stream = (RowStream*)sink;
+  size_t linebytes = stream->linebytes;
+
+  while(out->size - stream->pos >= linebytes + 1) {
+    unsigned char* recon = &stream->band[(stream->count + 1) * linebytes];
+    const unsigned char* precon = (stream->y + stream->count) ? recon - linebytes : 0;
+    unsigned char filterType = out->data[stream->pos];
+
+    if(stream->y + stream->count >= stream->h) return 91; /*decompressed size doesn't match prediction*/
+    CERROR_TRY_RETURN(unfilterScanline(recon, &out->data[stream->pos + 1], precon,
+                                       stream->bytewidth, filterType, linebytes));
+    stream->pos += linebytes + 1;
+    ++stream->count;
+    if(stream->count == stream->max_rows) CERROR_TRY_RETURN(rowStreamEmit(stream));
+  }
+
+  if(final) {
+    if(stream->count) CERROR_TRY_RETURN(rowStreamEmit(stream));
+    if(stream->y != stream->h || stream->pos != out->size) return 91;
+  } else if(out->size >= sink->threshold) {
+    /*remove the scanlines which are done, but keep the window the coming matches may refer to*/
+    size_t amount = out->size - 32768u;
+    size_t i;
+    if(amount > stream->pos) amount = stream->pos;
+    sink->adler = update_adler32(sink->adler, out->data, (unsigned)amount);
+    for(i = amount; i != out->size; ++i) out->data[i - amount] = out->data[i];
+    out->size -= amount;
+    sink->removed += amount;
+    stream->pos -= amount;
+    /*an unfinished long scanline may stay, so wait for the next step from here on*/
+    sink->threshold = out->size + stream->step;
+  }
+  return 0;
+}
+
+/*inflates the image data while unfiltering and passing on the rows. Returns 0 without doing
+anything if the image can't be streamed, otherwise 1 with the result in state->error.*/
+static unsigned decodeRowsStreaming(unsigned* w, unsigned* h, LodePNGState* state,
+                                    const unsigned char* in, size_t insize,
+                                    unsigned max_rows, LodePNGRowCallback callback, void* user) {
+  unsigned char* idat;
+  size_t idatsize;
+  const LodePNGDecompressSettings* settings = &state->decoder.zlibsettings;
+  RowStream stream;
+  ucvector scanlines = ucvector_init(NULL, 0);
+
+  /*Adam7 passes don't come in the order of the rows and custom decompressors return all data at once*/
+  if(settings->custom_zlib || settings->custom_inflate) return 0;
+  state->error = lodepng_inspect(w, h, state, in, insize);
+  if(state->error) return 1;
+  if(state->info_png.interlace_method != 0) return 0;
+
+  decodeChunks(&idat, &idatsize, w, h, 0, 0, state, in, insize);
+
+  if(!state->error) {
+    if(!state->decoder.color_convert) {
+      state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+    } else if(!lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)
+              && !(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+              && !(state->info_raw.bitdepth == 8)) {
+      state->error = 56; /*unsupported color mode conversion*/
+    }
+  }
+
+  lodepng_memset(&stream, 0, sizeof(stream));
+  if(!state->error) {
+    unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+    if(max_rows > *h) max_rows = *h;
+    stream.mode_png = &state->info_png.color;
+    stream.mode_raw = &state->info_raw;
+    stream.w = *w;
+    stream.h = *h;
+    stream.max_rows = max_rows;
+    stream.bytewidth = (bpp + 7u) / 8u;
+    stream.linebytes = lodepng_get_raw_size_idat(*w, 1, bpp) - 1u;
+    stream.rawbytes = lodepng_get_raw_size(*w, 1, &state->info_raw);
+    stream.callback = callback;
+    stream.user = user;
+
+    /*flush after at least a band or the window of 32768 bytes, whichever is larger*/
+    stream.step = max_rows * (stream.linebytes + 1u);
+    if(stream.step < 32768u) stream.step = 32768u;
+    stream.sink.flush = rowStreamFlush;
+    stream.sink.threshold = 32768u + stream.step;
+    stream.sink.adler = 1u;
+
+    stream.band = (unsigned char*)lodepng_malloc((max_rows + 1u) * stream.linebytes);
+    if(!lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
+      stream.converted = (unsigned char*)lodepng_malloc(max_rows * stream.rawbytes);
+      if(!stream.converted) state->error = 83; /*alloc fail*/
+    }
+    /*reserve the memory to avoid intermediate reallocations*/
+    if(!stream.band || !ucvector_resize(&scanlines, stream.sink.threshold + 65536u)) state->error = 83;
+    scanlines.size = 0;
+  }
+
+  if(!state->error) {
+    state->error = lodepng_zlib_decompressv(&scanlines, idat, idatsize, settings, &stream.sink);
+  }
+
+  lodepng_free(idat);
+  lodepng_free(scanlines.data);
+  lodepng_free(stream.band);
+  lodepng_free(stream.converted);
+  return 1;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*gives a completely decoded image to the callback in bands, for images that can't be streamed*/
+static unsigned decodeRowsFromImage(const unsigned char* image, unsigned w, unsigned h,
+                                    const LodePNGColorMode* mode, unsigned max_rows,
+                                    LodePNGRowCallback callback, void* user) {
+  size_t rawbytes = lodepng_get_raw_size(w, 1, mode);
+  size_t linebits = (size_t)w * lodepng_get_bpp(mode);
+  unsigned char* band = 0;
+  unsigned y, i, count;
+
+  if(!rowsAreAligned(w, mode)) {
+    /*the rows share bytes, copy them into a band where every row starts at a byte*/
+    band = (unsigned char*)lodepng_malloc(max_rows * rawbytes);
+    if(!band) return 83; /*alloc fail*/
+  }
+
+  for(y = 0; y < h; y += count) {
+    const unsigned char* rows = &image[y * rawbytes];
+    count = h - y < max_rows ? h - y : max_rows;
+    if(band) {
+      lodepng_memset(band, 0, count * rawbytes);
+      for(i = 0; i != count; ++i) {
+        size_t ibp = (y + i) * linebits, obp = i * rawbytes * 8u, x;
+        for(x = 0; x != linebits; ++x) {
+          unsigned char bit = readBitFromReversedStream(&ibp, image);
+          setBitOfReversedStream(&obp, band, bit);
+        }
+      }
+      rows = band;
+    }
+    if(callback(user, rows, y, count)) {
+      lodepng_free(band);
+      return 109;
+    }
+  }
+
+  lodepng_free(band);
+  return 0;
+}
+
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             unsigned max_rows, LodePNGRowCallback callback, void* user) {
+  unsigned char* image = 0;
+
+  if(max_rows == 0) max_rows = 1;
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(decodeRowsStreaming(w, h, state, in, insize, max_rows, callback, user)) return state->error;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+  state->error = lodepng_decode(&image, w, h, state, in, insize);
+  if(!state->error) {
+    state->error = decodeRowsFromImage(image, *w, *h, &state->info_raw, max_rows, callback, user);
+  }
+  lodepng_free(image);
+  return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth) {
   unsigned error;
@@ -4977,6 +6106,17 @@ unsigned lodepng_decode_file(unsigned char** out, unsigned* w, unsigned* h, cons
   /* safe output values in case error happens */
   *out = 0;
   *w = *h = 0;
+#ifdef LODEPNG_COMPILE_MMAP
+  {
+    /*decode straight from the mapped file, this saves the copy into buffer*/
+    const unsigned char* mapping;
+    if(!lodepng_map_file(&mapping, &buffersize, filename)) {
+      error = lodepng_decode_memory(out, w, h, mapping, buffersize, colortype, bitdepth);
+      lodepng_unmap_file(mapping, buffersize);
+      return error;
+    }
+  }
+#endif /*LODEPNG_COMPILE_MMAP*/
   error = lodepng_load_file(&buffer, &buffersize, filename);
   if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
   lodepng_free(buffer);
@@ -5125,13 +6265,54 @@ static unsigned addChunk_tRNS(ucvector* out, const LodePNGColorMode* info) {
   return 0;
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*pdIX: the offset in the zlib data and the first scanline of each segment, 4 bytes each*/
+static unsigned addChunk_pdIX(ucvector* out, const size_t* ends, size_t numsegments, unsigned segment_rows) {
+  unsigned char* chunk;
+  size_t i;
+  /*the offsets are 31-bit like chunk lengths, larger streams get no index*/
+  if(ends[numsegments - 1] > 2147483647u || numsegments > 2147483647u / 8u) return 0;
+  CERROR_TRY_RETURN(lodepng_chunk_init(&chunk, out, (unsigned)(numsegments * 8u), "pdIX"));
+  for(i = 0; i != numsegments; ++i) {
+    lodepng_set32bitInt(chunk + 8 + i * 8, i == 0 ? 2u : (unsigned)ends[i - 1]);
+    lodepng_set32bitInt(chunk + 12 + i * 8, (unsigned)(i * segment_rows));
+  }
+  lodepng_chunk_generate_crc(chunk);
+  return 0;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*linebytes is the size of a filtered scanline, or 0 if the scanlines do not have one size. If segment_rows
+is not 0, the image data is compressed as independent segments of that many scanlines with a pdIX chunk*/
 static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t datasize,
-                              LodePNGCompressSettings* zlibsettings) {
+                              LodePNGCompressSettings* zlibsettings, size_t linebytes, unsigned segment_rows) {
   unsigned error = 0;
   unsigned char* zlib = 0;
   size_t zlibsize = 0;
+  LodePNGCompressSettings settings = *zlibsettings;
 
-  error = zlib_compress(&zlib, &zlibsize, data, datasize, zlibsettings);
+  /*let the chunks of the parallel deflate start at a scanline*/
+  if(settings.chunksize && linebytes) {
+    settings.chunksize = (settings.chunksize + linebytes - 1u) / linebytes * linebytes;
+  }
+
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(segment_rows && linebytes && segment_rows < datasize / linebytes && !settings.custom_zlib &&
+     !settings.custom_deflate && (settings.btype == 1 || settings.btype == 2)) {
+    size_t segmentsize = segment_rows * linebytes;
+    size_t numsegments = (datasize + segmentsize - 1u) / segmentsize;
+    size_t* ends = (size_t*)lodepng_malloc(numsegments * sizeof(size_t));
+    if(!ends) return 83; /*alloc fail*/
+    error = zlibCompressChunks(&zlib, &zlibsize, ends, data, datasize, segmentsize, 0, &settings);
+    if(!error) error = addChunk_pdIX(out, ends, numsegments, segment_rows);
+    lodepng_free(ends);
+  } else
+#else /*no LODEPNG_COMPILE_ZLIB*/
+  (void)segment_rows;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  {
+    error = zlib_compress(&zlib, &zlibsize, data, datasize, &settings);
+  }
   if(!error) {
     error = lodepng_chunk_createv(out, zlibsize, "IDAT", zlib);
   }
@@ -5376,6 +6557,171 @@ static void filterScanline(unsigned char* out, const unsigned char* scanline, co
   }
 }
 
+/*the sum of the bytes of a scanline filtered with filterType, as used by LFS_MINSUM*/
+static size_t filterSum(const unsigned char* filtered, size_t length, unsigned char filterType) {
+  size_t i, sum = 0;
+  if(filterType == 0) {
+    for(i = 0; i != length; ++i) sum += filtered[i];
+  } else {
+    for(i = 0; i != length; ++i) {
+      /*For differences, each byte should be treated as signed, values above 127 are negative
+      (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
+      This means filtertype 0 is almost never chosen, but that is justified.*/
+      unsigned char s = filtered[i];
+      sum += s < 128 ? s : (255U - s);
+    }
+  }
+  return sum;
+}
+
+#ifdef LODEPNG_COMPILE_SIMD
+/*
+SSE2 and AVX2 versions of filterScanlineAll. The encoder filters the unfiltered scanline, so unlike in the decoder
+there's no dependency between the pixels and every byte uses the vectors x, a, b, c of the byte, the byte on the
+left, above and above left, for any pixel size. The first pixel and the bytes after the last full vector are done
+one by one by filterByteAll.
+*/
+
+/*all five filter types of one byte, with the sums as in filterSum*/
+static void filterByteAll(unsigned char* attempt[5], size_t sums[5], size_t i,
+                          unsigned char x, unsigned char a, unsigned char b, unsigned char c) {
+  unsigned char type;
+  attempt[0][i] = x;
+  attempt[1][i] = x - a;
+  attempt[2][i] = x - b;
+  attempt[3][i] = x - ((a + b) >> 1);
+  attempt[4][i] = x - paethPredictor(a, b, c);
+  sums[0] += x;
+  for(type = 1; type != 5; ++type) {
+    unsigned char s = attempt[type][i];
+    sums[type] += s < 128 ? s : (255U - s);
+  }
+}
+
+/*stores the filtered vector and adds its bytes to the sum, as signed values like filterSum does for types 1-4*/
+__attribute__((target("sse2")))
+static __m128i filterStoreSSE2(unsigned char* out, __m128i filtered, __m128i sum) {
+  /*255 - s for the negative values is the same as flipping all bits*/
+  __m128i magnitude = _mm_xor_si128(filtered, _mm_cmplt_epi8(filtered, _mm_setzero_si128()));
+  _mm_storeu_si128((__m128i*)out, filtered);
+  return _mm_add_epi64(sum, _mm_sad_epu8(magnitude, _mm_setzero_si128()));
+}
+
+/*the sum of the two 64-bit lanes, wrapping around like the size_t sums of filterSum*/
+__attribute__((target("sse2")))
+static size_t filterSumLanes(__m128i sum) {
+  unsigned lanes[4];
+  _mm_storeu_si128((__m128i*)lanes, sum);
+  return lanes[0] + ((size_t)lanes[1] << 16u << 16u) + lanes[2] + ((size_t)lanes[3] << 16u << 16u);
+}
+
+__attribute__((target("sse2")))
+static void filterScanlineAllSSE2(unsigned char* attempt[5], size_t sums[5], const unsigned char* scanline,
+                                  const unsigned char* prevline, size_t length, size_t bytewidth) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i vsums[5];
+  size_t i;
+  unsigned char type;
+  for(type = 0; type != 5; ++type) vsums[type] = zero;
+  for(i = 0; i != bytewidth && i != length; ++i) {
+    filterByteAll(attempt, sums, i, scanline[i], 0, prevline ? prevline[i] : 0, 0);
+  }
+  for(; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+    __m128i a = _mm_loadu_si128((const __m128i*)(scanline + i - bytewidth));
+    __m128i b = prevline ? _mm_loadu_si128((const __m128i*)(prevline + i)) : zero;
+    __m128i c = prevline ? _mm_loadu_si128((const __m128i*)(prevline + i - bytewidth)) : zero;
+    __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    __m128i paeth = _mm_packus_epi16(
+        paethPredictorSSE2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+        paethPredictorSSE2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+    _mm_storeu_si128((__m128i*)(attempt[0] + i), x);
+    vsums[0] = _mm_add_epi64(vsums[0], _mm_sad_epu8(x, zero));
+    vsums[1] = filterStoreSSE2(attempt[1] + i, _mm_sub_epi8(x, a), vsums[1]);
+    vsums[2] = filterStoreSSE2(attempt[2] + i, _mm_sub_epi8(x, b), vsums[2]);
+    vsums[3] = filterStoreSSE2(attempt[3] + i, _mm_sub_epi8(x, average), vsums[3]);
+    vsums[4] = filterStoreSSE2(attempt[4] + i, _mm_sub_epi8(x, paeth), vsums[4]);
+  }
+  for(; i != length; ++i) {
+    filterByteAll(attempt, sums, i, scanline[i], scanline[i - bytewidth],
+                  prevline ? prevline[i] : 0, prevline ? prevline[i - bytewidth] : 0);
+  }
+  for(type = 0; type != 5; ++type) {
+    sums[type] += filterSumLanes(vsums[type]);
+  }
+}
+
+__attribute__((target("avx2")))
+static __m256i filterStoreAVX2(unsigned char* out, __m256i filtered, __m256i sum) {
+  __m256i magnitude = _mm256_xor_si256(filtered, _mm256_cmpgt_epi8(_mm256_setzero_si256(), filtered));
+  _mm256_storeu_si256((__m256i*)out, filtered);
+  return _mm256_add_epi64(sum, _mm256_sad_epu8(magnitude, _mm256_setzero_si256()));
+}
+
+/*the same with 32 bytes at a time, the unpacking to 16-bit lanes and back works within each 128-bit half*/
+__attribute__((target("avx2")))
+static void filterScanlineAllAVX2(unsigned char* attempt[5], size_t sums[5], const unsigned char* scanline,
+                                  const unsigned char* prevline, size_t length, size_t bytewidth) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  __m256i vsums[5];
+  size_t i;
+  unsigned char type;
+  for(type = 0; type != 5; ++type) vsums[type] = zero;
+  for(i = 0; i != bytewidth && i != length; ++i) {
+    filterByteAll(attempt, sums, i, scanline[i], 0, prevline ? prevline[i] : 0, 0);
+  }
+  for(; i + 32 <= length; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(scanline + i));
+    __m256i a = _mm256_loadu_si256((const __m256i*)(scanline + i - bytewidth));
+    __m256i b = prevline ? _mm256_loadu_si256((const __m256i*)(prevline + i)) : zero;
+    __m256i c = prevline ? _mm256_loadu_si256((const __m256i*)(prevline + i - bytewidth)) : zero;
+    __m256i average = _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), one));
+    __m256i paeth = _mm256_packus_epi16(
+        paethPredictorAVX2(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(c, zero)),
+        paethPredictorAVX2(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(c, zero)));
+    _mm256_storeu_si256((__m256i*)(attempt[0] + i), x);
+    vsums[0] = _mm256_add_epi64(vsums[0], _mm256_sad_epu8(x, zero));
+    vsums[1] = filterStoreAVX2(attempt[1] + i, _mm256_sub_epi8(x, a), vsums[1]);
+    vsums[2] = filterStoreAVX2(attempt[2] + i, _mm256_sub_epi8(x, b), vsums[2]);
+    vsums[3] = filterStoreAVX2(attempt[3] + i, _mm256_sub_epi8(x, average), vsums[3]);
+    vsums[4] = filterStoreAVX2(attempt[4] + i, _mm256_sub_epi8(x, paeth), vsums[4]);
+  }
+  for(; i != length; ++i) {
+    filterByteAll(attempt, sums, i, scanline[i], scanline[i - bytewidth],
+                  prevline ? prevline[i] : 0, prevline ? prevline[i - bytewidth] : 0);
+  }
+  for(type = 0; type != 5; ++type) {
+    sums[type] += filterSumLanes(_mm_add_epi64(_mm256_castsi256_si128(vsums[type]),
+                                               _mm256_extracti128_si256(vsums[type], 1)));
+  }
+}
+#endif /*LODEPNG_COMPILE_SIMD*/
+
+/*
+Filters the scanline with each of the five filter types, into attempt[0] to attempt[4], and outputs the sum of
+each as used by LFS_MINSUM. With SIMD all five are computed in a single pass over the scanline.
+*/
+static void filterScanlineAll(unsigned char* attempt[5], size_t sums[5], const unsigned char* scanline,
+                              const unsigned char* prevline, size_t length, size_t bytewidth) {
+  unsigned char type;
+  for(type = 0; type != 5; ++type) sums[type] = 0;
+#ifdef LODEPNG_COMPILE_SIMD
+  if(__builtin_cpu_supports("avx2")) {
+    filterScanlineAllAVX2(attempt, sums, scanline, prevline, length, bytewidth);
+    return;
+  } else if(__builtin_cpu_supports("sse2")) {
+    filterScanlineAllSSE2(attempt, sums, scanline, prevline, length, bytewidth);
+    return;
+  }
+#endif /*LODEPNG_COMPILE_SIMD*/
+  for(type = 0; type != 5; ++type) {
+    filterScanline(attempt[type], scanline, prevline, length, bytewidth, type);
+    sums[type] = filterSum(attempt[type], length, type);
+  }
+}
+
 /* integer binary logarithm, max return value is 31 */
 static size_t ilog2(size_t i) {
   size_t result = 0;
@@ -5446,6 +6792,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   } else if(strategy == LFS_MINSUM) {
     /*adaptive filtering*/
     unsigned char* attempt[5]; /*five filtering attempts, one for each filter type*/
+    size_t sums[5];
     size_t smallest = 0;
     unsigned char type, bestType = 0;
 
@@ -5457,27 +6804,12 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     if(!error) {
       for(y = 0; y != h; ++y) {
         /*try the 5 filter types*/
+        filterScanlineAll(attempt, sums, &in[y * linebytes], prevline, linebytes, bytewidth);
         for(type = 0; type != 5; ++type) {
-          size_t sum = 0;
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
-
-          /*calculate the sum of the result*/
-          if(type == 0) {
-            for(x = 0; x != linebytes; ++x) sum += (unsigned char)(attempt[type][x]);
-          } else {
-            for(x = 0; x != linebytes; ++x) {
-              /*For differences, each byte should be treated as signed, values above 127 are negative
-              (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-              This means filtertype 0 is almost never chosen, but that is justified.*/
-              unsigned char s = attempt[type][x];
-              sum += s < 128 ? s : (255U - s);
-            }
-          }
-
           /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-          if(type == 0 || sum < smallest) {
+          if(type == 0 || sums[type] < smallest) {
             bestType = type;
-            smallest = sum;
+            smallest = sums[type];
           }
         }
 
@@ -5492,6 +6824,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     for(type = 0; type != 5; ++type) lodepng_free(attempt[type]);
   } else if(strategy == LFS_ENTROPY) {
     unsigned char* attempt[5]; /*five filtering attempts, one for each filter type*/
+    size_t sums[5]; /*not used, only the filtered scanlines are*/
     size_t bestSum = 0;
     unsigned type, bestType = 0;
     unsigned count[256];
@@ -5504,9 +6837,9 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     if(!error) {
       for(y = 0; y != h; ++y) {
         /*try the 5 filter types*/
+        filterScanlineAll(attempt, sums, &in[y * linebytes], prevline, linebytes, bytewidth);
         for(type = 0; type != 5; ++type) {
           size_t sum = 0;
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
           lodepng_memset(count, 0, 256 * sizeof(*count));
           for(x = 0; x != linebytes; ++x) ++count[attempt[type][x]];
           ++count[type]; /*the filter type itself is part of the scanline*/
@@ -5558,6 +6891,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     images only, so disable it*/
     zlibsettings.custom_zlib = 0;
     zlibsettings.custom_deflate = 0;
+    zlibsettings.chunksize = 0;
     for(type = 0; type != 5; ++type) {
       attempt[type] = (unsigned char*)lodepng_malloc(linebytes);
       if(!attempt[type]) error = 83; /*alloc fail*/
@@ -5660,6 +6994,25 @@ static void Adam7_interlace(unsigned char* out, const unsigned char* in, unsigne
   }
 }
 
+/*let the first scanline of every segment of segment_rows scanlines not depend on the scanline above it, so
+that the segments can be unfiltered independently: filter types Up, Average and Paeth become Sub. out and in
+are as given to filter.*/
+static void filterSegmentStarts(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                                const LodePNGColorMode* color, unsigned segment_rows) {
+  unsigned bpp = lodepng_get_bpp(color);
+  size_t linebytes = lodepng_get_raw_size_idat(w, 1, bpp) - 1u;
+  size_t bytewidth = (bpp + 7u) / 8u;
+  unsigned y;
+
+  for(y = segment_rows; y < h; y += segment_rows) {
+    unsigned char* line = &out[(size_t)y * (linebytes + 1)];
+    if(line[0] > 1) {
+      line[0] = 1;
+      filterScanline(line + 1, &in[(size_t)y * linebytes], 0, linebytes, bytewidth, 1);
+    }
+  }
+}
+
 /*out must be buffer big enough to contain uncompressed IDAT chunk data, and in must contain the full image.
 return value is error**/
 static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const unsigned char* in,
@@ -5686,11 +7039,17 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
         if(!error) {
           addPaddingBits(padded, in, ((w * bpp + 7u) / 8u) * 8u, w * bpp, h);
           error = filter(*out, padded, w, h, &info_png->color, settings);
+          if(!error && settings->segment_rows) {
+            filterSegmentStarts(*out, padded, w, h, &info_png->color, settings->segment_rows);
+          }
         }
         lodepng_free(padded);
       } else {
         /*we can immediately filter into the out buffer, no other steps needed*/
         error = filter(*out, in, w, h, &info_png->color, settings);
+        if(!error && settings->segment_rows) {
+          filterSegmentStarts(*out, in, w, h, &info_png->color, settings->segment_rows);
+        }
       }
     }
   } else /*interlace_method is 1 (Adam7)*/ {
@@ -5947,7 +7306,9 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*IDAT (multiple IDAT chunks must be consecutive)*/
-    state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
+    state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings,
+                                 info.interlace_method == 0 && h != 0 ? datasize / h : 0,
+                                 info.interlace_method == 0 ? state->encoder.segment_rows : 0);
     if(state->error) goto cleanup;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     /*tIME*/
@@ -6077,6 +7438,7 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings) {
   settings->filter_strategy = LFS_MINSUM;
   settings->auto_convert = 1;
   settings->force_palette = 0;
+  settings->segment_rows = 0;
   settings->predefined_filters = 0;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   settings->add_id = 0;
@@ -6204,6 +7566,7 @@ const char* lodepng_error_text(unsigned code) {
     case 106: return "PNG file must have PLTE chunk if color type is palette";
     case 107: return "color convert from palette mode requested without setting the palette data in it";
     case 108: return "tried to add more than 256 values to a palette";
+    case 109: return "the row callback stopped decoding";
   }
   return "unknown error code";
 }
@@ -6340,6 +7703,18 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const
   std::vector<unsigned char> buffer;
   /* safe output values in case error happens */
   w = h = 0;
+#ifdef LODEPNG_COMPILE_MMAP
+  {
+    /*decode straight from the mapped file instead of copying it into the vector*/
+    const unsigned char* mapping;
+    size_t mappingsize;
+    if(!lodepng_map_file(&mapping, &mappingsize, filename.c_str())) {
+      unsigned error = decode(out, w, h, mapping, mappingsize, colortype, bitdepth);
+      lodepng_unmap_file(mapping, mappingsize);
+      return error;
+    }
+  }
+#endif /*LODEPNG_COMPILE_MMAP*/
   unsigned error = load_file(buffer, filename);
   if(error) return error;
   return decode(out, w, h, buffer, colortype, bitdepth);
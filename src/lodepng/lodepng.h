@@ -65,6 +65,18 @@ the custom_zlib field of the compress and decompress settings*/
 #define LODEPNG_COMPILE_DISK
 #endif
 
+/*map input files into memory instead of reading them into a buffer, only
+available on POSIX systems. Requires LODEPNG_COMPILE_DISK.*/
+#if defined(LODEPNG_COMPILE_DISK) && !defined(LODEPNG_NO_COMPILE_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define LODEPNG_COMPILE_MMAP
+#endif
+
+/*SSE2 and AVX2 versions of the scanline filters, chosen at runtime by what the cpu
+supports. Only available with GCC compatible compilers on x86.*/
+#if !defined(LODEPNG_NO_COMPILE_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LODEPNG_COMPILE_SIMD
+#endif
+
 /*support for chunks other than IHDR, IDAT, PLTE, tRNS, IEND: ancillary and unknown chunks*/
 #ifndef LODEPNG_NO_COMPILE_ANCILLARY_CHUNKS
 #define LODEPNG_COMPILE_ANCILLARY_CHUNKS
@@ -279,6 +291,11 @@ struct LodePNGDecompressSettings {
   unsigned (*custom_inflate)(unsigned char**, size_t*,
                              const unsigned char*, size_t,
                              const LodePNGDecompressSettings*);
+  /*run task(data, i) for each i in [0, count), possibly concurrently, and return the first error a task
+  returned. If set, the PNG decoder inflates and unfilters the segments of images with a pdIX chunk
+  (see segment_rows of LodePNGEncoderSettings) as separate tasks. The tasks do not share state. (default: null)*/
+  unsigned (*custom_parallel)(unsigned (*task)(void*, size_t), void* data, size_t count,
+                              const LodePNGDecompressSettings*);
 
   const void* custom_context; /*optional custom settings for custom functions*/
 };
@@ -302,6 +319,11 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
 
+  /*if not 0, the zlib encoder splits the input in chunks of this many bytes which are deflated independently,
+  each using the last window of the chunk before it as dictionary. The PNG encoder rounds it up to whole
+  scanlines. Costs a bit of compression, see custom_parallel. Default: 0*/
+  size_t chunksize;
+
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
                           const unsigned char*, size_t,
@@ -312,6 +334,11 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned (*custom_deflate)(unsigned char**, size_t*,
                              const unsigned char*, size_t,
                              const LodePNGCompressSettings*);
+  /*run task(data, i) for each i in [0, count), possibly concurrently, and return the first error a task
+  returned. Used to deflate the chunks of chunksize, for example on a thread pool, since lodepng itself
+  does not start threads. The tasks do not share state. If null, they run one after another. (default: null)*/
+  unsigned (*custom_parallel)(unsigned (*task)(void*, size_t), void* data, size_t count,
+                              const LodePNGCompressSettings*);
 
   const void* custom_context; /*optional custom settings for custom functions*/
 };
@@ -722,6 +749,13 @@ typedef struct LodePNGEncoderSettings {
   /*force creating a PLTE chunk if colortype is 2 or 6 (= a suggested palette).
   If colortype is 3, PLTE is _always_ created.*/
   unsigned force_palette;
+  /*if not 0, write the image data as segments of this many scanlines which can be decoded independently:
+  the first scanline of a segment only uses filter None or Sub, the zlib stream is fully flushed between
+  the segments, and their offsets are stored in a private pdIX chunk before the IDAT chunks. The file stays
+  a normal PNG for other decoders. Only for non interlaced images, and ignored if custom_zlib or
+  custom_deflate is used or if btype is 0. The segments are deflated with zlibsettings.custom_parallel.
+  Default: 0*/
+  unsigned segment_rows;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   /*add LodePNG identifier and version as a text chunk, for debugging*/
   unsigned add_id;
@@ -771,6 +805,26 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*
+Receives the rows y to y + count - 1 of the image from lodepng_decode_rows, in the color
+type of state->info_raw. Each row has lodepng_get_raw_size(w, 1, &state->info_raw) bytes
+and starts at a byte, also for bit depths below 8 where the rows of lodepng_decode share
+bytes. The rows are only valid during the call. Return nonzero to stop decoding with error 109.
+*/
+typedef unsigned (*LodePNGRowCallback)(void* user, const unsigned char* rows, unsigned y, unsigned count);
+
+/*
+Same as lodepng_decode, but instead of returning the whole image, the rows are given to the
+callback from top to bottom in bands of max_rows rows (only the last band may be smaller)
+while the image data is still being decompressed. Next to the compressed data, only about
+two bands of rows and the 32 KB window of the decompressor are kept in memory.
+Interlaced images and custom zlib or inflate functions can't be streamed, these are decoded
+completely first and then given to the callback in the same bands.
+*/
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             unsigned max_rows, LodePNGRowCallback callback, void* user);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /*
@@ -962,6 +1016,24 @@ filename: the path to the file to save to
 return value: error code (0 means ok)
 */
 unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const char* filename);
+
+#ifdef LODEPNG_COMPILE_MMAP
+/*
+Map a file from disk into memory read-only, without copying it into a buffer.
+The mapping is advised for sequential access, so the kernel reads ahead while
+the decoder consumes it. Release it with lodepng_unmap_file, not with free.
+The file decode functions use this automatically and fall back to
+lodepng_load_file for files that can't be mapped, such as pipes.
+out: output parameter, pointer to the mapped file, or NULL for an empty file
+outsize: output parameter, size of the file
+filename: the path to the file to map
+return value: error code (0 means ok)
+*/
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, const char* filename);
+
+/*Release a mapping of lodepng_map_file. Does nothing if buffer is NULL.*/
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize);
+#endif /*LODEPNG_COMPILE_MMAP*/
 #endif /*LODEPNG_COMPILE_DISK*/
 
 #ifdef LODEPNG_COMPILE_CPP
@@ -1201,6 +1201,49 @@ void testDiskPNG(const std::string& filename) {
   doCodecTest(image);
 }
 
+void testMapFile() {
+  std::cout << "testMapFile" << std::endl;
+
+  unsigned w = 67, h = 45;
+  std::vector<unsigned char> image(w * h * 4);
+  for(size_t i = 0; i < image.size(); i++) image[i] = (unsigned char)(i * 7 + i / 13);
+
+  std::vector<unsigned char> png;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png, image, w, h));
+
+  const std::string filename = "lodepng_unittest_map.png";
+  ASSERT_NO_PNG_ERROR(lodepng::save_file(png, filename));
+
+#ifdef LODEPNG_COMPILE_MMAP
+  const unsigned char* mapping;
+  size_t mappingsize;
+  ASSERT_NO_PNG_ERROR(lodepng_map_file(&mapping, &mappingsize, filename.c_str()));
+  ASSERT_EQUALS(png.size(), mappingsize);
+  ASSERT_EQUALS(0, memcmp(&png[0], mapping, mappingsize));
+  lodepng_unmap_file(mapping, mappingsize);
+
+  ASSERT_EQUALS(78, lodepng_map_file(&mapping, &mappingsize, "lodepng_unittest_missing.png"));
+  ASSERT_EQUALS(0, mapping);
+#endif /*LODEPNG_COMPILE_MMAP*/
+
+  /*the file decoders read from the mapping*/
+  std::vector<unsigned char> decoded;
+  unsigned w2, h2;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(decoded, w2, h2, filename));
+  ASSERT_EQUALS(w, w2);
+  ASSERT_EQUALS(h, h2);
+  ASSERT_EQUALS(true, image == decoded);
+
+  unsigned char* decoded2;
+  ASSERT_NO_PNG_ERROR(lodepng_decode32_file(&decoded2, &w2, &h2, filename.c_str()));
+  ASSERT_EQUALS(0, memcmp(&image[0], decoded2, image.size()));
+  free(decoded2);
+
+  ASSERT_EQUALS(78, lodepng_decode32_file(&decoded2, &w2, &h2, "lodepng_unittest_missing.png"));
+
+  remove(filename.c_str());
+}
+
 std::vector<unsigned> strtovector(const std::string& numbers) {
   std::vector<unsigned> result;
   std::stringstream ss(numbers);
@@ -1224,6 +1267,317 @@ void doTestHuffmanCodeLengths(const std::string& expectedstr, const std::string&
   assertEquals(ss1.str(), ss2.str(), "value");
 }
 
+struct RowCollector {
+  std::vector<unsigned char> rows;
+  size_t rowbytes;
+  unsigned next_y;
+  unsigned max_rows;
+  unsigned stop_at;
+};
+
+static unsigned collectRows(void* user, const unsigned char* rows, unsigned y, unsigned count) {
+  RowCollector* collector = (RowCollector*)user;
+  ASSERT_EQUALS(collector->next_y, y);
+  assertTrue(count > 0 && count <= collector->max_rows, "band size");
+  collector->next_y += count;
+  collector->rows.insert(collector->rows.end(), rows, rows + count * collector->rowbytes);
+  return y + count > collector->stop_at;
+}
+
+// Decodes the png with lodepng_decode_rows and compares the rows with the image of lodepng_decode
+void doDecodeRowsTest(const std::vector<unsigned char>& png, unsigned max_rows,
+                      LodePNGColorType colortype, unsigned bitdepth, bool color_convert = true) {
+  unsigned w, h;
+  std::vector<unsigned char> image;
+  lodepng::State state;
+  state.info_raw.colortype = colortype;
+  state.info_raw.bitdepth = bitdepth;
+  state.decoder.color_convert = color_convert;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(image, w, h, state, png));
+
+  RowCollector collector;
+  collector.next_y = 0;
+  collector.max_rows = max_rows;
+  collector.stop_at = (unsigned)(-1);
+  lodepng::State state2;
+  state2.info_raw.colortype = colortype;
+  state2.info_raw.bitdepth = bitdepth;
+  state2.decoder.color_convert = color_convert;
+  collector.rowbytes = (w * lodepng_get_bpp(&state.info_raw) + 7) / 8;
+  ASSERT_NO_PNG_ERROR(lodepng_decode_rows(&w, &h, &state2, &png[0], png.size(), max_rows, collectRows, &collector));
+  ASSERT_EQUALS(h, collector.next_y);
+  ASSERT_EQUALS(state.info_raw.colortype, state2.info_raw.colortype);
+  ASSERT_EQUALS(state.info_raw.bitdepth, state2.info_raw.bitdepth);
+
+  // the rows start at a byte, lodepng_decode packs the bits of the rows together
+  size_t linebits = (size_t)w * lodepng_get_bpp(&state.info_raw);
+  for(unsigned y = 0; y < h; y++) {
+    for(size_t i = 0; i < linebits; i++) {
+      size_t bit = y * linebits + i;
+      size_t bit2 = y * collector.rowbytes * 8 + i;
+      ASSERT_EQUALS((image[bit / 8] >> (7 - bit % 8)) & 1, (collector.rows[bit2 / 8] >> (7 - bit2 % 8)) & 1);
+    }
+  }
+}
+
+// RGBA image of the row and segment tests, with too much detail for deflate to compress it to a few bytes
+static std::vector<unsigned char> generateRowsTestImage(unsigned w, unsigned h) {
+  std::vector<unsigned char> image((size_t)w * h * 4);
+  for(size_t i = 0; i < image.size(); i++) image[i] = (unsigned char)((i * 7 + i / 13) ^ (i >> 9));
+  return image;
+}
+
+// 1-bit grey image, whose rows don't end at a byte, and the state that encodes it without conversion
+static std::vector<unsigned char> generateGrey1TestImage(lodepng::State& state, unsigned w, unsigned h) {
+  std::vector<unsigned char> grey((size_t)(w + 7) / 8 * h);
+  for(size_t i = 0; i < grey.size(); i++) grey[i] = (unsigned char)(i * 37 + i / 5);
+  state.info_raw.colortype = LCT_GREY;
+  state.info_raw.bitdepth = 1;
+  state.info_png.color.colortype = LCT_GREY;
+  state.info_png.color.bitdepth = 1;
+  state.encoder.auto_convert = 0;
+  return grey;
+}
+
+void testDecodeRows() {
+  std::cout << "testDecodeRows" << std::endl;
+
+  // large enough for the decompressor to flush the scanlines several times
+  unsigned w = 301, h = 211;
+  std::vector<unsigned char> image = generateRowsTestImage(w, h);
+  std::vector<unsigned char> png;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png, image, w, h));
+  doDecodeRowsTest(png, 5, LCT_RGBA, 8);
+  doDecodeRowsTest(png, 1, LCT_RGB, 8);
+  doDecodeRowsTest(png, 1000, LCT_RGBA, 16);
+
+  // stored blocks are only flushed at the end of each block
+  lodepng::State state;
+  state.encoder.zlibsettings.btype = 0;
+  std::vector<unsigned char> stored;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(stored, image, w, h, state));
+  doDecodeRowsTest(stored, 7, LCT_RGBA, 8);
+
+  // bit depths below 8 with rows that don't end at a byte
+  lodepng::State state2;
+  std::vector<unsigned char> grey = generateGrey1TestImage(state2, w, h);
+  std::vector<unsigned char> png1;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png1, grey, w, h, state2));
+  doDecodeRowsTest(png1, 3, LCT_RGBA, 8);
+  doDecodeRowsTest(png1, 4, LCT_GREY, 1, false);
+
+  // interlaced images are decoded completely and given out in the same bands
+  lodepng::State state3;
+  state3.info_png.interlace_method = 1;
+  std::vector<unsigned char> interlaced;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(interlaced, image, w, h, state3));
+  doDecodeRowsTest(interlaced, 16, LCT_RGBA, 8);
+  std::vector<unsigned char> interlaced1;
+  state2.info_png.interlace_method = 1;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(interlaced1, grey, w, h, state2));
+  doDecodeRowsTest(interlaced1, 6, LCT_GREY, 1, false);
+
+  // the callback can stop decoding
+  RowCollector collector;
+  collector.rowbytes = w * 4;
+  collector.next_y = 0;
+  collector.max_rows = 10;
+  collector.stop_at = 50;
+  lodepng::State state4;
+  unsigned w2, h2;
+  ASSERT_EQUALS(109, lodepng_decode_rows(&w2, &h2, &state4, &png[0], png.size(), 10, collectRows, &collector));
+  ASSERT_EQUALS(60, collector.next_y);
+
+  // corrupted image data is still detected
+  std::vector<unsigned char> broken = png;
+  broken[broken.size() - 20] ^= 1;
+  collector.next_y = 0;
+  collector.stop_at = (unsigned)(-1);
+  lodepng::State state5;
+  state5.decoder.ignore_crc = 1;
+  ASSERT_EQUALS(58, lodepng_decode_rows(&w2, &h2, &state5, &broken[0], broken.size(), 10, collectRows, &collector));
+}
+
+// runs the tasks of the segment decoder backwards and counts them
+static unsigned countedDecodeTasks(unsigned (*task)(void*, size_t), void* data, size_t count,
+                                   const LodePNGDecompressSettings* settings) {
+  (*(size_t*)settings->custom_context) += count;
+  for(size_t i = count; i > 0; i--) {
+    unsigned error = task(data, i - 1);
+    if(error) return error;
+  }
+  return 0;
+}
+
+static void doDecodeSegmentsTest(const std::vector<unsigned char>& png, const std::vector<unsigned char>& image,
+                                 size_t expected_tasks) {
+  size_t tasks = 0;
+  lodepng::State state;
+  state.decoder.zlibsettings.custom_parallel = countedDecodeTasks;
+  state.decoder.zlibsettings.custom_context = &tasks;
+  std::vector<unsigned char> decoded;
+  unsigned w, h;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(decoded, w, h, state, png));
+  ASSERT_EQUALS(expected_tasks, tasks);
+  ASSERT_EQUALS(true, decoded == image);
+}
+
+// runs the tasks of the segment decoder and keeps the error of the first task that fails
+static unsigned checkedDecodeTasks(unsigned (*task)(void*, size_t), void* data, size_t count,
+                                   const LodePNGDecompressSettings* settings) {
+  unsigned* result = (unsigned*)settings->custom_context;
+  *result = 0;
+  for(size_t i = 0; i < count; i++) {
+    *result = task(data, i);
+    if(*result) return *result;
+  }
+  return 0;
+}
+
+static void appendChunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data) {
+  unsigned char* out = png.empty() ? 0 : (unsigned char*)malloc(png.size());
+  size_t outsize = png.size();
+  for(size_t i = 0; i < png.size(); i++) out[i] = png[i];
+  ASSERT_NO_PNG_ERROR(lodepng_chunk_create(&out, &outsize, (unsigned)data.size(), type, data.empty() ? 0 : &data[0]));
+  png.assign(out, out + outsize);
+  free(out);
+}
+
+// An 8 bit RGBA png of which every scanline has the given filter type (0, 1 or 2), with the image data
+// as one stored deflate block per segment of segment_rows scanlines and a pdIX chunk pointing to them.
+static std::vector<unsigned char> makeSegmentedPNG(const std::vector<unsigned char>& image, unsigned w, unsigned h,
+                                                   const std::vector<unsigned char>& types, unsigned segment_rows) {
+  size_t linebytes = w * 4;
+  std::vector<unsigned char> scanlines;
+  for(size_t y = 0; y < h; y++) {
+    scanlines.push_back(types[y]);
+    for(size_t x = 0; x < linebytes; x++) {
+      unsigned char value = image[y * linebytes + x];
+      if(types[y] == 1 && x >= 4) value -= image[y * linebytes + x - 4];
+      if(types[y] == 2 && y > 0) value -= image[(y - 1) * linebytes + x];
+      scanlines.push_back(value);
+    }
+  }
+
+  std::vector<unsigned char> zlib, index;
+  zlib.push_back(0x78);
+  zlib.push_back(0x01);
+  for(unsigned y = 0; y < h; y += segment_rows) {
+    size_t begin = y * (linebytes + 1), end = (y + segment_rows < h ? y + segment_rows : h) * (linebytes + 1);
+    size_t len = end - begin;
+    for(int shift = 24; shift >= 0; shift -= 8) index.push_back((unsigned char)(zlib.size() >> shift));
+    for(int shift = 24; shift >= 0; shift -= 8) index.push_back((unsigned char)(y >> shift));
+    zlib.push_back(y + segment_rows >= h ? 1 : 0); // BFINAL, BTYPE 00
+    zlib.push_back(len & 255);
+    zlib.push_back(len >> 8);
+    zlib.push_back(~len & 255);
+    zlib.push_back((~len >> 8) & 255);
+    zlib.insert(zlib.end(), scanlines.begin() + begin, scanlines.begin() + end);
+  }
+  unsigned s1 = 1, s2 = 0;
+  for(size_t i = 0; i < scanlines.size(); i++) {
+    s1 = (s1 + scanlines[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  unsigned adler = (s2 << 16) | s1;
+  for(int shift = 24; shift >= 0; shift -= 8) zlib.push_back((unsigned char)(adler >> shift));
+
+  std::vector<unsigned char> png, header(13, 0);
+  const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  png.assign(signature, signature + 8);
+  for(int i = 0; i < 4; i++) header[i] = (unsigned char)(w >> (24 - 8 * i));
+  for(int i = 0; i < 4; i++) header[4 + i] = (unsigned char)(h >> (24 - 8 * i));
+  header[8] = 8;
+  header[9] = 6; // RGBA
+  appendChunk(png, "IHDR", header);
+  appendChunk(png, "pdIX", index);
+  appendChunk(png, "IDAT", zlib);
+  appendChunk(png, "IEND", std::vector<unsigned char>());
+  return png;
+}
+
+void testSegmentIndex() {
+  std::cout << "testSegmentIndex" << std::endl;
+
+  unsigned w = 301, h = 211;
+  std::vector<unsigned char> image = generateRowsTestImage(w, h);
+  lodepng::State state;
+  state.encoder.segment_rows = 20;
+  std::vector<unsigned char> png;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png, image, w, h, state));
+
+  // 11 segments, of which the first scanlines don't refer to the scanline above
+  const unsigned char* index = lodepng_chunk_find_const(&png[8], &png[png.size()], "pdIX");
+  ASSERT_EQUALS(true, index != 0);
+  ASSERT_EQUALS(88, lodepng_chunk_length(index));
+  std::vector<unsigned char> types;
+  ASSERT_NO_PNG_ERROR(lodepng::getFilterTypes(types, png));
+  for(size_t y = 20; y < h; y += 20) ASSERT_EQUALS(true, types[y] <= 1);
+
+  // decoded in segments, and the same as ordinary decoding
+  doDecodeSegmentsTest(png, image, 11);
+  std::vector<unsigned char> decoded;
+  unsigned w2, h2;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(decoded, w2, h2, png));
+  ASSERT_EQUALS(true, decoded == image);
+
+  // a wrong offset makes the segments fail, the image is then decoded in one stream
+  std::vector<unsigned char> broken = png;
+  unsigned char* chunk = lodepng_chunk_find(&broken[8], &broken[broken.size()], "pdIX");
+  chunk[8 + 5 * 8 + 3]++;
+  lodepng_chunk_generate_crc(chunk);
+  doDecodeSegmentsTest(broken, image, 11);
+
+  // the encoder replaces a Paeth filter at the start of a segment by Sub, so the segments still decode
+  lodepng::State state2;
+  state2.encoder.segment_rows = 20;
+  state2.encoder.filter_strategy = LFS_FOUR;
+  std::vector<unsigned char> png2;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png2, image, w, h, state2));
+  ASSERT_NO_PNG_ERROR(lodepng::getFilterTypes(types, png2));
+  ASSERT_EQUALS(1, types[20]);
+  ASSERT_EQUALS(4, types[21]);
+  doDecodeSegmentsTest(png2, image, 11);
+
+  // a segment whose first scanline refers to the one above is rejected by the decoder, which then decodes
+  // the image in one stream
+  {
+    unsigned w4 = 16, h4 = 8;
+    std::vector<unsigned char> image4(w4 * h4 * 4);
+    for(size_t i = 0; i < image4.size(); i++) image4[i] = (unsigned char)(i * 29 + i / 7);
+    for(unsigned char type = 1; type <= 2; type++) {
+      std::vector<unsigned char> types4(h4, 2);
+      types4[0] = 0;
+      types4[4] = type;
+      std::vector<unsigned char> png4 = makeSegmentedPNG(image4, w4, h4, types4, 4);
+      unsigned segment_error = 1;
+      lodepng::State state4;
+      state4.decoder.zlibsettings.custom_parallel = checkedDecodeTasks;
+      state4.decoder.zlibsettings.custom_context = &segment_error;
+      std::vector<unsigned char> decoded4;
+      ASSERT_NO_PNG_ERROR(lodepng::decode(decoded4, w2, h2, state4, png4));
+      ASSERT_EQUALS(type == 1 ? 0 : 36, segment_error);
+      ASSERT_EQUALS(true, decoded4 == image4);
+    }
+  }
+
+  // rows that don't end at a byte are not decoded in segments
+  lodepng::State state3;
+  std::vector<unsigned char> grey = generateGrey1TestImage(state3, w, h);
+  state3.encoder.segment_rows = 16;
+  std::vector<unsigned char> png3;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png3, grey, w, h, state3));
+  std::vector<unsigned char> expected;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(expected, w2, h2, state3, png3));
+  size_t tasks = 0;
+  state3.decoder.zlibsettings.custom_parallel = countedDecodeTasks;
+  state3.decoder.zlibsettings.custom_context = &tasks;
+  std::vector<unsigned char> decoded3;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(decoded3, w2, h2, state3, png3));
+  ASSERT_EQUALS(0, tasks);
+  ASSERT_EQUALS(true, decoded3 == expected);
+}
+
 void testHuffmanCodeLengths() {
   bool atleasttwo = true; //LodePNG generates at least two, instead of at least one, symbol
   if(atleasttwo) {
@@ -1704,6 +2058,66 @@ void testCustomDeflate() {
   ASSERT_EQUALS(5555, error);
 }
 
+void testChunkedDeflate() {
+  std::cout << "testChunkedDeflate" << std::endl;
+
+  // zeros give long matches across the chunk boundaries
+  std::vector<unsigned char> in(100000);
+  for(size_t i = 0; i < in.size(); i++) in[i] = (i / 3000) % 2 ? 0 : (unsigned char)(i * 31 + i / 7);
+
+  struct TestFun {
+    static unsigned custom_parallel(unsigned (*task)(void*, size_t), void* data, size_t count,
+                                    const LodePNGCompressSettings* settings) {
+      // run the tasks backwards to prove they don't depend on each other
+      (*(size_t*)settings->custom_context) = count;
+      for(size_t i = count; i > 0; i--) {
+        unsigned error = task(data, i - 1);
+        if(error) return error;
+      }
+      return 0;
+    }
+  };
+
+  for(unsigned btype = 1; btype <= 2; btype++) {
+    size_t count = 0;
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    settings.btype = btype;
+    settings.windowsize = 32768;
+    settings.chunksize = 7000;
+    settings.custom_parallel = TestFun::custom_parallel;
+    settings.custom_context = &count;
+
+    unsigned char* zlib = 0;
+    size_t zlibsize = 0;
+    ASSERT_NO_PNG_ERROR(lodepng_zlib_compress(&zlib, &zlibsize, &in[0], in.size(), &settings));
+    ASSERT_EQUALS(15, count);
+
+    // the decoder checks the combined adler32
+    unsigned char* out = 0;
+    size_t outsize = 0;
+    ASSERT_NO_PNG_ERROR(lodepng_zlib_decompress(&out, &outsize, zlib, zlibsize, &lodepng_default_decompress_settings));
+    ASSERT_EQUALS(in.size(), outsize);
+    ASSERT_EQUALS(0, memcmp(&in[0], out, outsize));
+    free(zlib);
+    free(out);
+  }
+
+  // an image with rows that don't divide the chunk size
+  Image image;
+  generateTestImage(image, 211, 173, LCT_RGBA, 8);
+  lodepng::State state;
+  state.encoder.zlibsettings.chunksize = 10000;
+  std::vector<unsigned char> png;
+  ASSERT_NO_PNG_ERROR(lodepng::encode(png, image.data, image.width, image.height, state));
+  std::vector<unsigned char> decoded;
+  unsigned w, h;
+  ASSERT_NO_PNG_ERROR(lodepng::decode(decoded, w, h, png));
+  ASSERT_EQUALS(211, w);
+  ASSERT_EQUALS(173, h);
+  ASSERT_EQUALS(true, decoded == image.data);
+}
+
 void testCustomZlibDecompress() {
   std::cout << "testCustomZlibDecompress" << std::endl;
   Image image;
@@ -1897,6 +2311,115 @@ void testPredefinedFilters() {
   for(size_t i = 0; i < h; i++) ASSERT_EQUALS(3, outfilters[i]);
 }
 
+// Every filter type on its own with 3 and 4 byte pixels and widths around the vector sizes, these are the cases
+// with a SIMD version of unfiltering. The adaptive strategies try all filter types at once with SIMD.
+void testUnfilterTypes() {
+  std::cout << "testUnfilterTypes" << std::endl;
+  const unsigned widths[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 13, 16, 17, 33, 100};
+  const LodePNGFilterStrategy strategies[] = {LFS_ONE, LFS_TWO, LFS_THREE, LFS_FOUR, LFS_MINSUM, LFS_ENTROPY};
+  const LodePNGColorType types[] = {LCT_RGB, LCT_RGBA};
+  unsigned h = 5;
+  unsigned seed = 1;
+  for(size_t t = 0; t < 2; t++)
+  for(size_t f = 0; f < 6; f++)
+  for(size_t i = 0; i < sizeof(widths) / sizeof(*widths); i++) {
+    unsigned w = widths[i];
+    // random bytes, to reach every choice of the paeth predictor
+    std::vector<unsigned char> image(w * h * (types[t] == LCT_RGB ? 3 : 4));
+    for(size_t j = 0; j < image.size(); j++) {
+      seed = seed * 1103515245u + 12345u;
+      image[j] = (unsigned char)(seed >> 16);
+    }
+
+    lodepng::State state;
+    state.info_raw.colortype = types[t];
+    state.info_png.color.colortype = types[t];
+    state.encoder.auto_convert = 0;
+    state.encoder.filter_strategy = strategies[f];
+    std::vector<unsigned char> png;
+    ASSERT_NO_PNG_ERROR(lodepng::encode(png, image, w, h, state));
+
+    std::vector<unsigned char> decoded;
+    unsigned w2, h2;
+    ASSERT_NO_PNG_ERROR(lodepng::decode(decoded, w2, h2, png, types[t], 8));
+    ASSERT_EQUALS(w, w2);
+    ASSERT_EQUALS(h, h2);
+    ASSERT_EQUALS(image.size(), decoded.size());
+    for(size_t j = 0; j < image.size(); j++) {
+      ASSERT_EQUALS((int)image[j], (int)decoded[j]);
+    }
+  }
+}
+
+// The filter types LFS_MINSUM chooses, computed in the plainest way: every filter type on its own and the sum of
+// the filtered bytes, as signed values for all but filter type None. The first type with the smallest sum wins.
+static std::vector<unsigned char> minsumFilterTypes(const std::vector<unsigned char>& image, size_t linebytes,
+                                                     size_t bytewidth, unsigned h) {
+  std::vector<unsigned char> types;
+  for(size_t y = 0; y < h; y++) {
+    size_t best = 0;
+    unsigned char bestType = 0;
+    for(unsigned char type = 0; type < 5; type++) {
+      size_t sum = 0;
+      for(size_t x = 0; x < linebytes; x++) {
+        int v = image[y * linebytes + x];
+        int a = x >= bytewidth ? image[y * linebytes + x - bytewidth] : 0;
+        int b = y > 0 ? image[(y - 1) * linebytes + x] : 0;
+        int c = x >= bytewidth && y > 0 ? image[(y - 1) * linebytes + x - bytewidth] : 0;
+        int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        int paeth = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+        int predictions[5] = {0, a, b, (a + b) / 2, paeth};
+        unsigned char filtered = (unsigned char)(v - predictions[type]);
+        sum += type == 0 || filtered < 128 ? filtered : 255 - filtered;
+      }
+      if(type == 0 || sum < best) {
+        best = sum;
+        bestType = type;
+      }
+    }
+    types.push_back(bestType);
+  }
+  return types;
+}
+
+// The SIMD filter selection must choose the same filter types as the scalar one, also for widths that don't fill
+// a whole vector
+void testMinsumFilterTypes() {
+  std::cout << "testMinsumFilterTypes" << std::endl;
+  const unsigned widths[] = {1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 33, 47, 65, 100};
+  const LodePNGColorType types[] = {LCT_GREY, LCT_GREY_ALPHA, LCT_RGB, LCT_RGBA};
+  const size_t channels[] = {1, 2, 3, 4};
+  unsigned h = 9;
+  unsigned seed = 3;
+  for(size_t t = 0; t < 4; t++)
+  for(unsigned bitdepth = 8; bitdepth <= 16; bitdepth += 8)
+  for(size_t i = 0; i < sizeof(widths) / sizeof(*widths); i++)
+  for(int noise = 0; noise < 2; noise++) {
+    unsigned w = widths[i];
+    size_t bytewidth = channels[t] * bitdepth / 8;
+    // noise and smooth gradients, so that every filter type gets chosen
+    std::vector<unsigned char> image(w * h * bytewidth);
+    for(size_t j = 0; j < image.size(); j++) {
+      seed = seed * 1103515245u + 12345u;
+      image[j] = noise ? (unsigned char)(seed >> 16) : (unsigned char)(j * 3 + j / 11 + ((seed >> 20) & 3));
+    }
+
+    lodepng::State state;
+    state.info_raw.colortype = types[t];
+    state.info_raw.bitdepth = bitdepth;
+    state.info_png.color.colortype = types[t];
+    state.info_png.color.bitdepth = bitdepth;
+    state.encoder.auto_convert = 0;
+    state.encoder.filter_strategy = LFS_MINSUM;
+    std::vector<unsigned char> png;
+    ASSERT_NO_PNG_ERROR(lodepng::encode(png, image, w, h, state));
+
+    std::vector<unsigned char> filterTypes;
+    ASSERT_NO_PNG_ERROR(lodepng::getFilterTypes(filterTypes, png));
+    ASSERT_EQUALS(true, filterTypes == minsumFilterTypes(image, w * bytewidth, bytewidth, h));
+  }
+}
+
 void testEncoderErrors() {
   std::cout << "testEncoderErrors" << std::endl;
 
@@ -3659,6 +4182,8 @@ void doMain() {
   testComplexPNG();
   testInspectChunk();
   testPredefinedFilters();
+  testUnfilterTypes();
+  testMinsumFilterTypes();
   testFuzzing();
   testEncoderErrors();
   testPaletteToPaletteDecode();
@@ -3666,6 +4191,9 @@ void doMain() {
   testColorProfile();
   testBkgdChunk();
   testBkgdChunk2();
+  testMapFile();
+  testDecodeRows();
+  testSegmentIndex();
 
   //Colors
 #ifndef DISABLE_SLOW
@@ -3690,6 +4218,7 @@ void doMain() {
   testCustomZlibCompress();
   testCustomZlibCompress2();
   testCustomDeflate();
+  testChunkedDeflate();
   testCustomZlibDecompress();
   testCustomInflate();
   testBitReader();
@@ -6,6 +6,7 @@
 #include <opencv2/opencv.hpp>
 #include "shared.hpp"
 #include "img_operations.hpp"
+#include "hsv.hpp"
 
 
 #define OPT(value, option) strcmp(value, option) == 0
@@ -39,6 +40,24 @@ uint32_t* mat_to_flat_array(Mat& mat)
 	return im;
 }
 
+/*
+ * Converts the three byte hsv pixels of op_hsv back to rgb in place for the export.
+ * The hue is scaled like COLOR_HSV2RGB of OpenCV, where 180 is a full turn.
+ */
+void hsv_bytes_to_rgb(uint32_t width, uint32_t height, uint8_t *data)
+{
+	for(size_t index = 0; index < (size_t)width * height * 3; index += 3)
+	{
+		float red, green, blue;
+
+		hsv_to_rgb(fmodf(data[index] / 30.0f, 6.0f), data[index + 1] / 255.0f, (float)data[index + 2], red, green, blue);
+
+		data[index] = (uint8_t)(red + 0.5f);
+		data[index + 1] = (uint8_t)(green + 0.5f);
+		data[index + 2] = (uint8_t)(blue + 0.5f);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	if(argc < 4)
@@ -68,7 +87,7 @@ int main(int argc, char **argv)
 	uint32_t *im = mat_to_flat_array(mat_in);
 	Mat mat_out;
 
-	clock_t clock_start, clock_end;
+	double clock_start, clock_end;
 	
 	ios_base::sync_with_stdio(false); 
 
@@ -76,32 +95,31 @@ int main(int argc, char **argv)
 
 	if(OPT(argv[1], "grey"))
 	{
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_grey(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 
 		mat_out = Mat(height, width, CV_8UC4, im);
 	} else if(OPT(argv[1], "emboss")) {
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_emboss(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 
 		mat_out = Mat(height, width, CV_8UC4, im);
 	} else if(OPT(argv[1], "blur")) {
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_blur(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 
 		mat_out = Mat(height, width, CV_8UC4, im);
 	} else if(OPT(argv[1], "hsv")) {
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_hsv(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 
+		/* The inverse conversion works in place, so no second image is needed. */
+		hsv_bytes_to_rgb(width, height, (uint8_t *)im);
 		mat_out = Mat(height, width, CV_8UC3, im);
-		Mat tmp = Mat(height, width, CV_8UC3);
-		cvtColor(mat_out, tmp, COLOR_HSV2RGB);
-		mat_out = tmp;
 	} else {
 		printf("The operation %s is not available.\n", argv[1]);
 		return EXIT_FAILURE;
@@ -115,8 +133,8 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	double cpu_time_taken = double(clock_end - clock_start) / CLOCKS_PER_SEC; 
-	printf("The operation completed successfully in %f sec.\n", cpu_time_taken);
+	double time_taken = clock_end - clock_start;
+	printf("The operation completed successfully in %f sec.\n", time_taken);
 
 	std::vector<int> compression_params;
 	compression_params.push_back(CV_IMWRITE_PNG_COMPRESSION);
@@ -86,27 +86,27 @@ int main(int argc, char **argv)
 
 	uint32_t *im = img_to_flat_array(img);
 
-	clock_t clock_start, clock_end;
+	double clock_start, clock_end;
 
 	int success = EXIT_FAILURE;
 
 	if(OPT(argv[1], "grey"))
 	{
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_grey(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 	} else if(OPT(argv[1], "emboss")) {
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_emboss(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 	} else if(OPT(argv[1], "blur")) {
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_blur(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 	} else if(OPT(argv[1], "hsv")) {
-		clock_start = clock();
+		clock_start = wall_clock();
 		success = op_hsv(width, height, im);
-		clock_end = clock();
+		clock_end = wall_clock();
 	} else {
 		printf("The operation %s is not available.\n", argv[1]);
 		return EXIT_FAILURE;
@@ -120,8 +120,8 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	double cpu_time_taken = double(clock_end - clock_start) / CLOCKS_PER_SEC; 
-	printf("The operation completed successfully in %f sec.\n", cpu_time_taken);
+	double time_taken = clock_end - clock_start;
+	printf("The operation completed successfully in %f sec.\n", time_taken);
 
 	img.save(argv[3]);
 
@@ -2,50 +2,952 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <math.h>
 #include <cstring>
+#include <ctype.h>
+#include <errno.h>
 #include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 #include "lodepng/lodepng.h"
 #include "shared.hpp"
 #include "img_operations.hpp"
+#include "bounded_queue.hpp"
 
 #define OPT(value, option) strcmp(value, option) == 0
 
 using namespace std;
 
+/*
+ * The operations of the command line. The steps point to the filters, blurs,
+ * lookup tables and hsv adjustments of the list, so the list can not be copied.
+ */
+struct operation_list
+{
+	op_step steps[OP_CHAIN_MAX];
+	uint32_t count = 0;
+	std::vector<std::unique_ptr<convolution_filter>> filters;
+	std::vector<std::unique_ptr<box_blur>> blurs;
+	std::vector<std::unique_ptr<point_lut>> luts;
+	std::vector<std::unique_ptr<hsv_adjust>> adjustments;
+};
+
+/*
+ * Parses a number like 0.5 or a fraction like 1/16.
+ * Returns false if the text at value is no finite number.
+ */
+bool parse_number(const char *&value, float &number)
+{
+	char *end;
+	number = strtof(value, &end);
+
+	if(end == value || !isfinite(number))
+		return false;
+
+	if(*end == '/')
+	{
+		const char *denominator_text = end + 1;
+		float denominator = strtof(denominator_text, &end);
+
+		if(end == denominator_text || denominator == 0.0f)
+			return false;
+
+		number /= denominator;
+
+		if(!isfinite(number))
+			return false;
+	}
+
+	value = end;
+
+	return true;
+}
+
+/*
+ * Parses a border mode like clamp and advances value behind it.
+ * Returns false if the mode is unknown.
+ */
+bool parse_border(const char *&value, uint32_t &border)
+{
+	static const char *names[] = {"skip", "clamp", "mirror", "wrap", "constant", "renormalize"};
+
+	size_t length = strcspn(value, " \t\r\n;,");
+
+	for(uint32_t mode = BORDER_SKIP; mode <= BORDER_RENORMALIZE; ++mode)
+	{
+		if(strlen(names[mode]) == length && strncmp(value, names[mode], length) == 0)
+		{
+			border = mode;
+			value += length;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Parses the weights of a filter. The rows are separated by new lines or
+ * semicolons and the weights by spaces, for example "1 2 1; 2 4 2; 1 2 1".
+ * With commas set the weights can also be separated by commas, which is only
+ * done for filter files because commas separate the operations of a chain.
+ * The optional entries factor=<number> and bias=<number> set the factor and
+ * the bias, by default the factor is one divided by the sum of the weights.
+ * The entry border=<mode> selects the border mode (skip, clamp, mirror, wrap,
+ * constant or renormalize) and color=<RRGGBBAA> the hex color of constant borders.
+ * Lines starting with # are comments.
+ */
+bool parse_filter_text(const char *text, convolution_filter *filter, bool commas)
+{
+	uint32_t columns = 0;
+	bool has_factor = false;
+
+	filter->width = 0;
+	filter->height = 0;
+	filter->bias = 0.0f;
+	filter->border = BORDER_SKIP;
+	filter->border_color = 0;
+
+	for(const char *c = text; ; )
+	{
+		if(*c == '\0' || *c == ';' || *c == '\n')
+		{
+			/* End of a row, empty rows are ignored. */
+			if(columns > 0)
+			{
+				if(filter->height == 0)
+					filter->width = columns;
+				else if(columns != filter->width)
+					return false;
+
+				if(++filter->height > CONVOLUTION_MAX_SIZE)
+					return false;
+
+				columns = 0;
+			}
+
+			if(*c++ == '\0')
+				break;
+		}
+		else if(*c == '#')
+		{
+			while(*c != '\0' && *c != '\n')
+				++c;
+		}
+		else if(isspace((unsigned char)*c) || (commas && *c == ','))
+		{
+			++c;
+		}
+		else if(strncmp(c, "factor=", 7) == 0)
+		{
+			c += 7;
+			has_factor = true;
+
+			if(!parse_number(c, filter->factor))
+				return false;
+		}
+		else if(strncmp(c, "bias=", 5) == 0)
+		{
+			c += 5;
+
+			if(!parse_number(c, filter->bias))
+				return false;
+		}
+		else if(strncmp(c, "border=", 7) == 0)
+		{
+			c += 7;
+
+			if(!parse_border(c, filter->border))
+				return false;
+		}
+		else if(strncmp(c, "color=", 6) == 0)
+		{
+			char *end;
+			uint32_t color = (uint32_t)strtoul(c + 6, &end, 16);
+
+			if(end != c + 14)
+				return false;
+
+			filter->border_color = RGBA32(color >> 24, (color >> 16) & COLOR8_MASK, (color >> 8) & COLOR8_MASK, color & COLOR8_MASK);
+			c = end;
+		}
+		else
+		{
+			float weight;
+
+			if(!parse_number(c, weight))
+				return false;
+
+			if(columns == CONVOLUTION_MAX_SIZE || (filter->height > 0 && columns == filter->width))
+				return false;
+
+			filter->weights[filter->height * (filter->height > 0 ? filter->width : 0) + columns++] = weight;
+		}
+	}
+
+	if(filter->height == 0)
+		return false;
+
+	if(!has_factor)
+	{
+		float sum = 0.0f;
+
+		for(uint32_t i = 0; i < filter->width * filter->height; ++i)
+			sum += filter->weights[i];
+
+		filter->factor = sum != 0.0f ? 1.0f / sum : 1.0f;
+	}
+
+	return true;
+}
+
+/*
+ * Reads a filter from a file or, if there is no such file, from the value itself.
+ */
+bool parse_filter(const char *value, convolution_filter *filter)
+{
+	FILE *file = fopen(value, "r");
+
+	if(file == NULL)
+		return parse_filter_text(value, filter, false);
+
+	char text[16384];
+	size_t size = fread(text, 1, sizeof(text) - 1, file);
+	bool complete = feof(file) != 0;
+
+	fclose(file);
+	text[size] = '\0';
+
+	return complete && parse_filter_text(text, filter, true);
+}
+
+/*
+ * Chooses the radii of passes box blurs whose result approximates a gaussian
+ * blur with the standard deviation sigma. The boxes have the two odd sizes
+ * around the ideal size, so the variance of all boxes matches sigma closely.
+ * Returns false if sigma is not positive or the boxes get too large.
+ */
+bool box_blur_gaussian(float sigma, uint32_t passes, box_blur *blur)
+{
+	if(!(sigma > 0.0f) || !isfinite(sigma) || passes == 0 || passes > BOX_BLUR_MAX_PASSES)
+		return false;
+
+	double n = passes;
+	double variance = 12.0 * (double)sigma * sigma;
+	double ideal = sqrt(variance / n + 1.0);
+
+	/* Checked before the cast, so the sizes below fit into int32_t. */
+	if(ideal > 2 * BOX_BLUR_MAX_RADIUS + 3)
+		return false;
+
+	int32_t lower = (int32_t)floor(ideal);
+
+	if(lower % 2 == 0)
+		--lower;
+
+	int32_t upper = lower + 2;
+	int32_t lower_count = (int32_t)lround((variance - n * lower * lower - 4.0 * n * lower - 3.0 * n) / (-4.0 * lower - 4.0));
+
+	if((upper - 1) / 2 > BOX_BLUR_MAX_RADIUS)
+		return false;
+
+	blur->passes = passes;
+
+	for(uint32_t pass = 0; pass < passes; ++pass)
+		blur->radius[pass] = (uint32_t)(((int32_t)pass < lower_count ? lower : upper) - 1) / 2;
+
+	return true;
+}
+
+/*
+ * Fills the tables of a point operation: gamma:<gamma>, brightness:<offset>,
+ * contrast:<factor>, invert or threshold:<level>. The curves change the
+ * color channels and keep the alpha channel.
+ * Returns false if name is no point operation or its parameter is invalid.
+ */
+bool parse_point_op(const char *name, point_lut *lut)
+{
+	const char *value = strchr(name, ':');
+	size_t length = value == NULL ? strlen(name) : (size_t)(value - name);
+	float number = 0.0f;
+
+	if(value != NULL)
+	{
+		++value;
+
+		if(!parse_number(value, number) || *value != '\0')
+			return false;
+	}
+
+	string operation(name, length);
+
+	if(operation == "invert" ? value != NULL : value == NULL)
+		return false;
+
+	if(operation == "gamma" && !(number > 0.0f))
+		return false;
+
+	for(uint32_t channel = 0; channel < 256; ++channel)
+	{
+		float color = (float)channel;
+
+		if(operation == "gamma")
+			color = 255.0f * powf(color / 255.0f, 1.0f / number);
+		else if(operation == "brightness")
+			color += number;
+		else if(operation == "contrast")
+			color = (color - 128.0f) * number + 128.0f;
+		else if(operation == "invert")
+			color = 255.0f - color;
+		else if(operation == "threshold")
+			color = color >= number ? 255.0f : 0.0f;
+		else
+			return false;
+
+		uint8_t result = (uint8_t)min(max(color + 0.5f, 0.0f), 255.0f);
+
+		lut->table[0][channel] = result;
+		lut->table[1][channel] = result;
+		lut->table[2][channel] = result;
+		lut->table[3][channel] = (uint8_t)channel;
+	}
+
+	return true;
+}
+
+/*
+ * Parses an hsv adjustment: hue:<degrees>, saturation:<factor>, value:<factor>
+ * or all three at once as hsv:<degrees>:<saturation factor>:<value factor>.
+ * Returns false if name is no hsv adjustment or a parameter is invalid.
+ */
+bool parse_hsv_adjust(const char *name, hsv_adjust *adjust)
+{
+	const char *value = strchr(name, ':');
+
+	if(value == NULL)
+		return false;
+
+	string operation(name, (size_t)(value - name));
+	float numbers[3] = {0.0f, 1.0f, 1.0f};
+	uint32_t first = 0, count = 1;
+
+	if(operation == "saturation")
+		first = 1;
+	else if(operation == "value")
+		first = 2;
+	else if(operation == "hsv")
+		count = 3;
+	else if(operation != "hue")
+		return false;
+
+	for(uint32_t i = first; i < first + count; ++i)
+	{
+		++value;
+
+		if(!parse_number(value, numbers[i]) || *value != (i + 1 < first + count ? ':' : '\0'))
+			return false;
+	}
+
+	if(numbers[1] < 0.0f || numbers[2] < 0.0f)
+		return false;
+
+	adjust->hue = numbers[0];
+	adjust->saturation = numbers[1];
+	adjust->value = numbers[2];
+
+	return true;
+}
+
+/*
+ * Parses a comma separated list of operations like blur,grey,emboss.
+ * A convolution is written as convolve:<filter file or filter text>, where
+ * the filter text can not contain commas and separates its weights by spaces,
+ * a box blur as box:<radius> and a box blur of three passes which
+ * approximates a gaussian blur as gaussian:<sigma>. The point operations
+ * of parse_point_op run as lookup tables, the ones of parse_hsv_adjust
+ * convert to hsv and back in one pass.
+ * Returns the number of operations or zero if one of them is unknown.
+ */
+uint32_t parse_chain(const char *value, operation_list &list)
+{
+	char names[4096];
+	uint32_t count = 0;
+
+	if(strlen(value) >= sizeof(names))
+		return 0;
+
+	strcpy(names, value);
+
+	for(char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		if(count == OP_CHAIN_MAX)
+			return 0;
+
+		op_step &step = list.steps[count++];
+		step.args = NULL;
+
+		if(OPT(name, "grey"))
+			step.op = OP_GREY;
+		else if(OPT(name, "hsv"))
+			step.op = OP_HSV;
+		else if(OPT(name, "emboss"))
+			step.op = OP_EMBOSS;
+		else if(OPT(name, "blur"))
+			step.op = OP_BLUR;
+		else if(strncmp(name, "blur:", 5) == 0)
+		{
+			/* The gaussian filter of op_blur with another border mode runs as a convolution. */
+			static const float gaussian[5] = {1.0f, 4.0f, 6.0f, 4.0f, 1.0f};
+			const char *mode = name + 5;
+
+			list.filters.emplace_back(new convolution_filter());
+			convolution_filter *filter = list.filters.back().get();
+
+			if(!parse_border(mode, filter->border) || *mode != '\0')
+				return 0;
+
+			filter->width = 5;
+			filter->height = 5;
+			filter->factor = 1.0f / 256.0f;
+			filter->bias = 0.0f;
+			filter->border_color = 0;
+
+			for(uint32_t i = 0; i < 25; ++i)
+				filter->weights[i] = gaussian[i / 5] * gaussian[i % 5];
+
+			step.op = OP_CONVOLVE;
+			step.args = filter;
+		}
+		else if(strncmp(name, "box:", 4) == 0 || strncmp(name, "gaussian:", 9) == 0)
+		{
+			bool box = name[0] == 'b';
+			const char *text = strchr(name, ':') + 1;
+			float number;
+
+			list.blurs.emplace_back(new box_blur());
+			box_blur *blur = list.blurs.back().get();
+
+			if(!parse_number(text, number) || *text != '\0')
+				return 0;
+
+			if(box)
+			{
+				if(number < 0.0f || number > BOX_BLUR_MAX_RADIUS || number != floorf(number))
+					return 0;
+
+				blur->passes = 1;
+				blur->radius[0] = (uint32_t)number;
+			}
+			else if(!box_blur_gaussian(number, 3, blur))
+				return 0;
+
+			step.op = OP_BOX_BLUR;
+			step.args = blur;
+		}
+		else if(strncmp(name, "gamma:", 6) == 0 || strncmp(name, "brightness:", 11) == 0 || strncmp(name, "contrast:", 9) == 0 ||
+			OPT(name, "invert") || strncmp(name, "threshold:", 10) == 0)
+		{
+			list.luts.emplace_back(new point_lut());
+
+			if(!parse_point_op(name, list.luts.back().get()))
+				return 0;
+
+			step.op = OP_LUT;
+			step.args = list.luts.back().get();
+		}
+		else if(strncmp(name, "hue:", 4) == 0 || strncmp(name, "saturation:", 11) == 0 || strncmp(name, "value:", 6) == 0 ||
+			strncmp(name, "hsv:", 4) == 0)
+		{
+			list.adjustments.emplace_back(new hsv_adjust());
+
+			if(!parse_hsv_adjust(name, list.adjustments.back().get()))
+				return 0;
+
+			step.op = OP_HSV_ADJUST;
+			step.args = list.adjustments.back().get();
+		}
+		else if(strncmp(name, "convolve:", 9) == 0)
+		{
+			list.filters.emplace_back(new convolution_filter());
+
+			if(!parse_filter(name + 9, list.filters.back().get()))
+				return 0;
+
+			step.op = OP_CONVOLVE;
+			step.args = list.filters.back().get();
+		}
+		else
+			return 0;
+	}
+
+	list.count = count;
+
+	return count;
+}
+
+/*
+ * lodepng decodes to rgba bytes. On little endian hosts four of these bytes
+ * already form a pixel of shared.hpp, so the operations work directly on the
+ * buffer of the decoder and the result is encoded from the same buffer.
+ * Big endian hosts swap the bytes of every pixel in place before and after.
+ */
+void swap_pixel_bytes(unsigned char *image, uint32_t pixels)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	uint32_t *im = (uint32_t *)image;
+
+	for(uint32_t i = 0; i < pixels; ++i)
+		im[i] = __builtin_bswap32(im[i]);
+#else
+	(void)image;
+	(void)pixels;
+#endif
+}
+
+/*
+ * Runs a single operation in place or a chain of operations.
+ */
+int run_operations(const operation_list &list, uint32_t width, uint32_t height, uint32_t *im)
+{
+	if(list.count == 1)
+	{
+		switch(list.steps[0].op)
+		{
+			case OP_GREY:
+				return op_grey(width, height, im);
+			case OP_EMBOSS:
+				return op_emboss(width, height, im);
+			case OP_BLUR:
+				return op_blur(width, height, im);
+			case OP_HSV:
+				return op_hsv(width, height, im);
+			case OP_CONVOLVE:
+				return op_convolve(width, height, im, (const convolution_filter *)list.steps[0].args);
+			case OP_BOX_BLUR:
+				return op_box_blur(width, height, im, (const box_blur *)list.steps[0].args);
+			case OP_LUT:
+				return op_lut(width, height, im, (const point_lut *)list.steps[0].args);
+			case OP_HSV_ADJUST:
+				return op_hsv_adjust(width, height, im, (const hsv_adjust *)list.steps[0].args);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	uint32_t *scratch = (uint32_t *)malloc(sizeof(uint32_t) * width * height);
+
+	if(scratch == NULL)
+		return EXIT_FAILURE;
+
+	int success = op_chain(width, height, list.steps, list.count, im, scratch);
+	free(scratch);
+
+	return success;
+}
+
+/* Size of the segments of the filtered image which are deflated and inflated on their own threads. */
+#define SEGMENT_SIZE 262144
+
+unsigned run_encode_tasks(unsigned (*task)(void *, size_t), void *data, size_t count, const LodePNGCompressSettings *)
+{
+	return op_run_tasks(task, data, count);
+}
+
+unsigned run_decode_tasks(unsigned (*task)(void *, size_t), void *data, size_t count, const LodePNGDecompressSettings *)
+{
+	return op_run_tasks(task, data, count);
+}
+
+/*
+ * Decodes a png file to rgba. Files with a segment index, like the ones of
+ * encode_file, are inflated and unfiltered in parallel by backends with threads.
+ */
+unsigned decode_file(const char *filename, unsigned char **image, unsigned *width, unsigned *height)
+{
+	LodePNGState state;
+	lodepng_state_init(&state);
+
+	if(op_threads() > 1)
+		state.decoder.zlibsettings.custom_parallel = run_decode_tasks;
+
+	size_t size = 0;
+	unsigned error = 0;
+	bool mapped = false;
+
+#ifdef LODEPNG_COMPILE_MMAP
+	const unsigned char *png = NULL;
+
+	/* Like lodepng_decode32_file, files which can't be mapped such as pipes are read into a buffer. */
+	if(lodepng_map_file(&png, &size, filename) == 0)
+	{
+		mapped = true;
+		error = lodepng_decode(image, width, height, &state, png, size);
+		lodepng_unmap_file(png, size);
+	}
+#endif
+
+	if(!mapped)
+	{
+		unsigned char *buffer = NULL;
+		error = lodepng_load_file(&buffer, &size, filename);
+
+		if(!error)
+			error = lodepng_decode(image, width, height, &state, buffer, size);
+
+		free(buffer);
+	}
+
+	lodepng_state_cleanup(&state);
+
+	return error;
+}
+
+/*
+ * Encodes the rgba image to a png file. The image data is split into segments
+ * of rows which backends with threads deflate in parallel and decode in parallel
+ * again, the file stays a normal png for other programs.
+ */
+unsigned encode_file(const char *filename, const unsigned char *image, unsigned width, unsigned height)
+{
+	LodePNGState state;
+	lodepng_state_init(&state);
+	state.encoder.segment_rows = std::max(SEGMENT_SIZE / (width * 4 + 1), 1u);
+
+	if(op_threads() > 1)
+		state.encoder.zlibsettings.custom_parallel = run_encode_tasks;
+
+	unsigned char *png = NULL;
+	size_t size = 0;
+	unsigned error = lodepng_encode(&png, &size, image, width, height, &state);
+
+	if(!error)
+		error = lodepng_save_file(png, size, filename);
+
+	lodepng_state_cleanup(&state);
+	free(png);
+
+	return error;
+}
+
+/*
+ * Collects the input files of a batch. The input is either a directory,
+ * of which all png files are used, or a text file with one path per line.
+ */
+bool collect_batch_files(const char *input, std::vector<std::string> &files)
+{
+	struct stat info;
+
+	if(stat(input, &info) != 0)
+		return false;
+
+	if(S_ISDIR(info.st_mode))
+	{
+		DIR *dir = opendir(input);
+
+		if(dir == NULL)
+			return false;
+
+		while(struct dirent *entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+
+			if(name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0)
+				files.push_back(std::string(input) + "/" + name);
+		}
+
+		closedir(dir);
+		std::sort(files.begin(), files.end());
+
+		return true;
+	}
+
+	FILE *list = fopen(input, "r");
+
+	if(list == NULL)
+		return false;
+
+	char line[4096];
+
+	while(fgets(line, sizeof(line), list) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if(line[0] != '\0')
+			files.push_back(line);
+	}
+
+	fclose(list);
+
+	return true;
+}
+
+/* The largest number of workers of a batch. */
+#define BATCH_MAX_WORKERS 256
+
+/*
+ * Parses the number of workers of a batch.
+ * Returns false if the text is no whole number in [1, BATCH_MAX_WORKERS].
+ */
+bool parse_workers(const char *value, uint32_t &workers)
+{
+	char *end;
+	long number = strtol(value, &end, 10);
+
+	if(end == value || *end != '\0' || number < 1 || number > BATCH_MAX_WORKERS)
+		return false;
+
+	workers = (uint32_t)number;
+
+	return true;
+}
+
+/*
+ * An image on its way through the batch pipeline.
+ */
+struct batch_job
+{
+	std::string output;
+	unsigned width;
+	unsigned height;
+	uint32_t *pixels;
+};
+
+/*
+ * Runs a pipeline stage on the given number of threads and closes
+ * the output queue once the last thread has finished.
+ */
+template<typename Stage>
+void start_stage(std::vector<std::thread> &threads, uint32_t count, bounded_queue<batch_job> *output, Stage stage)
+{
+	std::shared_ptr<std::atomic<uint32_t>> running = std::make_shared<std::atomic<uint32_t>>(count);
+
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		threads.emplace_back([=]()
+		{
+			stage();
+
+			if(--*running == 0 && output != NULL)
+				output->close();
+		});
+	}
+}
+
+/*
+ * Processes all files of a batch in a pipeline of three stages which
+ * are connected by bounded queues: decode, compute and encode.
+ * While one image is modified the next one is decoded and the previous one
+ * is encoded, so the cores stay busy and no process is started per file.
+ * The workers are split across the stages, every stage gets at least one.
+ * Deflating takes the longest and inflating the second longest, so the
+ * encode and then the decode stage get the remaining workers.
+ */
+int run_batch(const operation_list &list, const char *input, const char *output_dir, uint32_t workers)
+{
+	std::vector<std::string> files;
+
+	if(!collect_batch_files(input, files))
+	{
+		printf("The input %s could not be read.\n", input);
+		return EXIT_FAILURE;
+	}
+
+	/* Files of a list with the same name in different directories would overwrite each other. */
+	std::vector<std::string> outputs;
+	std::set<std::string> names;
+
+	for(const std::string &file : files)
+	{
+		std::string name = file.substr(file.find_last_of('/') + 1);
+
+		if(!names.insert(name).second)
+		{
+			printf("The input contains more than one file named %s.\n", name.c_str());
+			return EXIT_FAILURE;
+		}
+
+		outputs.push_back(std::string(output_dir) + "/" + name);
+	}
+
+	struct stat info;
+
+	if(mkdir(output_dir, 0755) != 0 && !(errno == EEXIST && stat(output_dir, &info) == 0 && S_ISDIR(info.st_mode)))
+	{
+		printf("The output directory %s could not be created.\n", output_dir);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t decoders = std::max(workers / 3 + (workers % 3 == 2), 1u);
+	uint32_t computers = std::max(workers / 3, 1u);
+	uint32_t encoders = std::max(workers / 3 + (workers % 3 != 0), 1u);
+
+	printf("Processing %zu files with %u decode, %u compute and %u encode workers.\n", files.size(), decoders, computers, encoders);
+
+	/* The queues hold at most one image per worker of the next stage. */
+	bounded_queue<batch_job> decoded(computers), computed(encoders);
+
+	std::atomic<uint32_t> next(0), failed(0), processed(0);
+	std::atomic<uint64_t> bytes(0);
+	std::vector<std::thread> threads;
+
+	double clock_start = wall_clock();
+
+	start_stage(threads, decoders, &decoded, [&]()
+	{
+		for(uint32_t index = next++; index < files.size(); index = next++)
+		{
+			const std::string &file = files[index];
+			unsigned char *image = NULL;
+			batch_job job;
+
+			if(lodepng_decode32_file(&image, &job.width, &job.height, file.c_str()))
+			{
+				printf("The file %s could not be loaded.\n", file.c_str());
+				free(image);
+				++failed;
+				continue;
+			}
+
+			swap_pixel_bytes(image, job.width * job.height);
+
+			job.output = outputs[index];
+			job.pixels = (uint32_t *)image;
+
+			decoded.push(std::move(job));
+		}
+	});
+
+	/* With the threaded backend one compute thread at a time uses the pool, the others run on their own thread. */
+	start_stage(threads, computers, &computed, [&]()
+	{
+		batch_job job;
+
+		while(decoded.pop(job))
+		{
+			if(run_operations(list, job.width, job.height, job.pixels) != EXIT_SUCCESS)
+			{
+				printf("The operation failed for %s.\n", job.output.c_str());
+				free(job.pixels);
+				++failed;
+				continue;
+			}
+
+			computed.push(std::move(job));
+		}
+	});
+
+	start_stage(threads, encoders, NULL, [&]()
+	{
+		batch_job job;
+
+		while(computed.pop(job))
+		{
+			uint32_t pixels = job.width * job.height;
+
+			swap_pixel_bytes((unsigned char *)job.pixels, pixels);
+			unsigned error = lodepng_encode32_file(job.output.c_str(), (unsigned char *)job.pixels, job.width, job.height);
+			free(job.pixels);
+
+			if(error)
+			{
+				printf("Export of %s failed: %s\n", job.output.c_str(), lodepng_error_text(error));
+				++failed;
+				continue;
+			}
+
+			bytes += (uint64_t)pixels * 4;
+			++processed;
+		}
+	});
+
+	for(std::thread &thread : threads)
+		thread.join();
+
+	double time_taken = wall_clock() - clock_start;
+	double megabytes = bytes / 1e6;
+
+	printf("Processed %u images (%.1f MB of pixels) in %f sec.\n", (uint32_t)processed, megabytes, time_taken);
+	printf("Throughput: %.2f images/sec, %.2f MB/sec.\n", processed / time_taken, megabytes / time_taken);
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char **argv)
 {
 	if(argc < 4)
 	{
-		printf("usage: %s <grey|emboss|blur|hsv> <input file> <output file>\n\n", argv[0]);
-		printf("convert image colors\n\tgrey\tconverts the colors to greyscale\n\thsv\tconverts the rgba to the hsv colorspace\n\n");
-		printf("apply filter to image\n\temboss\tapplies the emboss filter\n\tblur\tblurs the image via a gaussian blur filter\n\n");
+		printf("usage: %s <grey|emboss|blur|hsv>[,...] <input file> <output file>\n\n", argv[0]);
+		printf("convert image colors\n\tgrey\tconverts the colors to greyscale\n\thsv\tconverts the rgba to the hsv colorspace\n");
+		printf("\tgamma:<gamma>\tapplies a gamma curve, values above 1 brighten the image\n");
+		printf("\tbrightness:<offset>\tadds the offset to the colors\n\tcontrast:<factor>\tscales the distance of the colors to 128\n");
+		printf("\tinvert\tinverts the colors\n\tthreshold:<level>\tsets the colors below the level to 0 and the others to 255\n");
+		printf("\thue:<degrees>\trotates the hue\n\tsaturation:<factor>\tscales the saturation\n\tvalue:<factor>\tscales the value\n");
+		printf("\thsv:<degrees>:<saturation>:<value>\tapplies all three hsv adjustments in one pass\n\n");
+		printf("apply filter to image\n\temboss\tapplies the emboss filter\n\tblur\tblurs the image via a gaussian blur filter\n");
+		printf("\tblur:<border>\tblurs with a border mode: skip, clamp, mirror, wrap, constant or renormalize\n");
+		printf("\tconvolve:<filter>\tconvolves the image with a filter file or a filter like \"1 2 1;2 4 2;1 2 1\"\n");
+		printf("\tbox:<radius>\tblurs with the mean of the pixels within the radius\n");
+		printf("\tgaussian:<sigma>\tapproximates a gaussian blur of any size with three box blurs\n\n");
+		printf("chain operations\n\tblur,grey\truns the operations one after another on the same image, hsv must be last\n\n");
+		printf("batch mode\n\t%s --batch <operation> <input directory|list file> <output directory> [workers]\n\n", argv[0]);
 		return 0;
 	}
 
+	if(OPT(argv[1], "--batch"))
+	{
+		operation_list list;
+		uint32_t count = argc < 5 ? 0 : parse_chain(argv[2], list);
+
+		if(count == 0)
+		{
+			printf("The operation %s is not available.\n", argc < 5 ? "" : argv[2]);
+			return EXIT_FAILURE;
+		}
+
+		uint32_t workers = std::thread::hardware_concurrency();
+
+		if(argc > 5 && !parse_workers(argv[5], workers))
+		{
+			printf("The number of workers must be between 1 and %u.\n", BATCH_MAX_WORKERS);
+			printf("usage: %s --batch <operation> <input directory|list file> <output directory> [workers]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		return run_batch(list, argv[3], argv[4], workers > 0 ? workers : 1);
+	}
+
+	operation_list list;
+	uint32_t count = parse_chain(argv[1], list);
+
+	if(count == 0)
+	{
+		printf("The operation %s is not available.\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
 	printf("The implementation uses lodepng.\n");
 
-	std::vector<unsigned char> image;
+	unsigned char *image = NULL;
 	unsigned image_width, image_height;
 
-	if(lodepng::decode(image, image_width, image_height, argv[2]))
+	if(decode_file(argv[2], &image, &image_width, &image_height))
 	{
 		printf("The file %s could not be loaded.\n", argv[2]);
 		return EXIT_FAILURE;
 	}
 
+	/* The operations work on the buffer of the decoder, there is no copy of the image. */
 	uint32_t pixels = image_height * image_width;
-	uint32_t *im = (uint32_t *)malloc(sizeof(uint32_t) * (pixels));
-	int offset = 0;
-
-	for(int i = 0; i < image.size(); i += 4)
-	{
-		uint8_t red = (uint8_t)image[i];
-		uint8_t green = (uint8_t)image[i+1];
-		uint8_t blue = (uint8_t)image[i+2];
-		uint8_t alpha = (uint8_t)image[i+3];
+	uint32_t *im = (uint32_t *)image;
 
-		im[offset++] = RGBA32(red, green, blue, alpha);
-	}
+	swap_pixel_bytes(image, pixels);
 
 	uint32_t width = image_width;
 	uint32_t height = image_height;
@@ -53,31 +955,11 @@ int main(int argc, char **argv)
 
 	printf("Loaded file %s with %d rows, %d columns and %d channels.\n", argv[2], height, width, channels);
 
-	clock_t clock_start, clock_end;
-
-	int success = EXIT_FAILURE;
-
-	if(OPT(argv[1], "grey"))
-	{
-		clock_start = clock();
-		success = op_grey(width, height, im);
-		clock_end = clock();
-	} else if(OPT(argv[1], "emboss")) {
-		clock_start = clock();
-		success = op_emboss(width, height, im);
-		clock_end = clock();
-	} else if(OPT(argv[1], "blur")) {
-		clock_start = clock();
-		success = op_blur(width, height, im);
-		clock_end = clock();
-	} else if(OPT(argv[1], "hsv")) {
-		clock_start = clock();
-		success = op_hsv(width, height, im);
-		clock_end = clock();
-	} else {
-		printf("The operation %s is not available.\n", argv[1]);
-		return EXIT_FAILURE;
-	}
+	double clock_start, clock_end;
+
+	clock_start = wall_clock();
+	int success = run_operations(list, width, height, im);
+	clock_end = wall_clock();
 
 	if(success != EXIT_SUCCESS)
 	{
@@ -85,20 +967,15 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	double cpu_time_taken = double(clock_end - clock_start) / CLOCKS_PER_SEC; 
-	printf("The operation completed successfully in %f sec.\n", cpu_time_taken);
+	double time_taken = clock_end - clock_start;
+	printf("The operation completed successfully in %f sec.\n", time_taken);
 
-	std::vector<unsigned char> output;
+	swap_pixel_bytes(image, pixels);
 
-	for(int i = 0; i < pixels; ++i)
-	{
-		output.push_back(RED8(im[i]));
-		output.push_back(GREEN8(im[i]));
-		output.push_back(BLUE8(im[i]));
-		output.push_back(ALPHA8(im[i]));
-	}
+	unsigned error = encode_file(argv[3], image, width, height);
+	free(image);
 
-	if(unsigned error = lodepng::encode(argv[3], output, width, height))
+	if(error)
 	{
 		printf("Export failed.\n");
 		printf("%s\n", lodepng_error_text(error));
@@ -4,95 +4,109 @@
 #include <algorithm>
 #include <string.h>
 #include "shared.hpp"
-
-/* Basic inlined math operations for the rgb format. */
-#define MAXRGB(r,g,b) (std::max(std::max(r, g), b))
-#define MINRGB(r,g,b) (std::min(std::min(r, g), b))
+#include "kernels.hpp"
+#include "convolution.hpp"
+#include "box_blur.hpp"
 
 using namespace std;
 
+/*
+ * Runs the ranges of a task one after another.
+ */
+static int run_serial(uint32_t count, uint32_t grain, const range_task &task)
+{
+	for(uint32_t begin = 0; begin < count; begin += grain)
+	{
+		if(task(begin, min(begin + grain, count)) != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
 /*
  * Greyscales the colors of the image.
+ * Uses the AVX2 or SSE4.1 kernel if the cpu supports it.
  */
+int op_grey(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	kernel_grey(width, height, in, out, 0, height);
+
+	return EXIT_SUCCESS;
+}
+
 int op_grey(uint32_t width, uint32_t height, uint32_t *data)
 {
-	for(int32_t row = height - 1; row >= 0; --row)
-	{
-		for(int32_t col = width - 1; col >= 0; --col)
-		{
-			uint32_t index = ARRAY2_IDX(row, col, width);
-			
-			uint8_t color = 
-				  (0.21 * RED8(data[index]))
-				+ (0.72 * GREEN8(data[index]))
-				+ (0.07 * BLUE8(data[index]));
+	return op_grey(width, height, data, data);
+}
 
-			uint8_t alpha = ALPHA8(data[index]);
+/*
+ * Replaces the channels of the image with the values of the lookup tables.
+ */
+int op_lut(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const point_lut *lut)
+{
+	kernel_lut(width, height, lut, in, out, 0, height);
 
-			data[index] = RGBA32(color, color, color, alpha);
-		}
-	}
+	return EXIT_SUCCESS;
+}
+
+int op_lut(uint32_t width, uint32_t height, uint32_t *data, const point_lut *lut)
+{
+	return op_lut(width, height, data, data, lut);
+}
+
+/*
+ * Rotates the hue and scales the saturation and the value of the image.
+ */
+int op_hsv_adjust(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const hsv_adjust *adjust)
+{
+	kernel_hsv_adjust(width, height, adjust, in, out, 0, height);
 
 	return EXIT_SUCCESS;
 }
 
+int op_hsv_adjust(uint32_t width, uint32_t height, uint32_t *data, const hsv_adjust *adjust)
+{
+	return op_hsv_adjust(width, height, data, data, adjust);
+}
+
 /*
  * Converts the colorspace from rgba to hsv.
+ * Uses the AVX2 or SSE4.1 kernel if the cpu supports it.
  */
-int op_hsv(uint32_t width, uint32_t height, uint32_t *data)
+int op_hsv(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
 {
-	for(int32_t row = 0; row < height; ++row)
-	{
-		for(int32_t col = 0; col < width; ++col)
-		{
-			uint32_t index = ARRAY2_IDX(row, col, width);
-			
-			int32_t next = index * 3; // hsv has only 3 channels
-
-			/* Normalize color values except alpha. */
-			uint8_t red = RED8(data[index]);
-			uint8_t green = GREEN8(data[index]);
-			uint8_t blue = BLUE8(data[index]);
-
-			/* Calulate conversion parameters */
-			uint8_t cmax = MAXRGB(red, green, blue);
-			uint8_t cmin = MINRGB(red, green, blue);
-			uint8_t diff = cmax - cmin;
-
-			/* Calculate hue. */
-			uint8_t hue = 0;
-
-			if(diff != 0)
-			{
-				if(cmax == red)
-					hue = 43 * ((green - blue) / diff);
-				else if(cmax == green)
-					hue = 85 + 43 * ((blue - red) / diff);
-				else
-					hue = 200 + 171 + 43 * ((red - green) / diff); /* 200 is temporary. It works for some reason. */
-			}
-
-			/* Calculate saturation. */
-			uint8_t saturation = cmax == 0 ? 0 : 255 * diff / cmax;
-			
-			/* Calculate value. */
-			uint8_t value = cmax;
-
-			/* Write only three channels. */
-			((uint8_t *)data)[next++] = hue;
-			((uint8_t *)data)[next++] = saturation;
-			((uint8_t *)data)[next++] = value;
-		}
-	}
+	kernel_hsv(width, height, in, (uint8_t *)out, 0, height);
 
 	return EXIT_SUCCESS;
 }
 
+int op_hsv(uint32_t width, uint32_t height, uint32_t *data)
+{
+	/* The three byte pixels are written behind the pixels that are already converted. */
+	return op_hsv(width, height, data, data);
+}
+
 /*
  * Applies a emboss filter to the image.
  */
+int op_emboss(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	kernel_emboss(width, height, in, out, 0, height);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Applies a emboss filter in place. The rows are embossed bottom up like
+ * in kernel_emboss_in_place, so only the first row has to be copied.
+ * Building with EMBOSS_COMPAT restores the original pixel by pixel loop,
+ * which processes the pixels backwards so the top left neighbour of a pixel
+ * is always read before it is overwritten. Both give the same result.
+ */
 int op_emboss(uint32_t width, uint32_t height, uint32_t *data)
 {
+#ifdef EMBOSS_COMPAT
 	int32_t diff_max = 0, diff_tmp = 0;
 
 	for(int32_t row = height - 1; row >= 0; --row)
@@ -127,85 +141,126 @@ int op_emboss(uint32_t width, uint32_t height, uint32_t *data)
 			);
 		}
 	}
+#else
+	if(height == 0)
+		return EXIT_SUCCESS;
+
+	uint32_t *top = (uint32_t *)malloc(sizeof(uint32_t) * width);
+
+	if(top == NULL)
+		return EXIT_FAILURE;
+
+	memcpy(top, data, sizeof(uint32_t) * width);
+	kernel_emboss_in_place(width, data, top, 0, height);
+	free(top);
+#endif
 
 	return EXIT_SUCCESS;
 }
 
 /*
  * Applies a gaussian blur filter to the image.
- * Works with different filters.
+ * The 5x5 filter is separated into a horizontal and a vertical pass,
+ * which needs 10 instead of 25 multiplications per channel.
+ * The arithmetic is selected by IMG_BLUR_PRECISION (see kernels.hpp).
  * Credits: https://lodev.org/cgtutor/filtering.html 
  */
+int op_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	if(kernel_blur_precision() == BLUR_PRECISION_INTEGER)
+		return kernel_blur_separable_integer(width, height, in, out, 0, height);
+
+	return kernel_blur_separable(width, height, in, out, 0, height);
+}
+
 int op_blur(uint32_t width, uint32_t height, uint32_t *data)
 {
-	const int32_t filter_size = 5;
-	const int32_t filter_pivot = filter_size / 2;
+	/* The separable blur only buffers five rows, so it can work in place. */
+	return op_blur(width, height, data, data);
+}
 
-	/*
-	double filter[filter_size][filter_size] =
-	{
-		{0.077847, 0.123317, 0.077847},
-		{0.123317, 0.195346, 0.123317},
-		{0.077847, 0.123317, 0.077847}
-	};
-	*/
+/*
+ * Convolves the image with the filter (see convolution.hpp).
+ */
+int op_convolve(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const convolution_filter *filter)
+{
+	return kernel_convolve(width, height, filter, in, out, 0, height);
+}
 
-	float filter[filter_size][filter_size] =
-	{
-		{1.0f,  4.0f,  6.0f,  4.0f,  1.0f},
-		{4.0f, 16.0f, 24.0f, 16.0f,  4.0f},
-		{6.0f, 24.0f, 36.0f, 24.0f,  6.0f},
-		{4.0f, 16.0f, 24.0f, 16.0f,  4.0f},
-		{1.0f,  4.0f,  6.0f,  4.0f,  1.0f}
-	};
+int op_convolve(uint32_t width, uint32_t height, uint32_t *data, const convolution_filter *filter)
+{
+	uint32_t *out = (uint32_t *)malloc(sizeof(uint32_t) * height * width);
 
-	float filter_factor = 1.0f / 256.0f;
-	float filter_bias = 0.0f;
+	if(out == NULL)
+		return EXIT_FAILURE;
 
-	uint32_t *out = (uint32_t *)malloc(sizeof(uint32_t) * (height * width));
+	int success = op_convolve(width, height, data, out, filter);
 
-	for(int32_t row = height - 1; row >= 0; --row)
-	{
-		for(int32_t col = width - 1; col >= 0; --col)
-		{
-			uint32_t index = ARRAY2_IDX(row, col, width);
+	if(success == EXIT_SUCCESS)
+		memcpy(data, out, sizeof(uint32_t) * height * width);
 
-			float red = 0, green = 0, blue = 0, alpha = 0;
+	free(out);
 
-			for(int32_t filter_y = 0; filter_y < filter_size; ++filter_y)
-			{
-				int32_t filter_y_idx = row - filter_pivot + filter_y;
+	return success;
+}
 
-				if(filter_y_idx < 0 || filter_y_idx >= height)
-					continue;
+/*
+ * Applies a box blur to the image (see box_blur.hpp).
+ */
+int op_box_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const box_blur *blur)
+{
+	uint32_t *scratch = (uint32_t *)malloc(sizeof(uint32_t) * height * width);
 
-				for(int32_t filter_x = 0; filter_x < filter_size; ++filter_x)
-				{
-					int32_t filter_x_idx = col - filter_pivot + filter_x;
+	if(scratch == NULL)
+		return EXIT_FAILURE;
 
-					if(filter_x_idx < 0 || filter_x_idx >= width)
-						continue;
+	int success = kernel_box_blur(width, height, blur, in, out, scratch, run_serial);
+	free(scratch);
 
-					int32_t filter_idx = ARRAY2_IDX(filter_y_idx, filter_x_idx, width);
+	return success;
+}
 
-					red += filter[filter_y][filter_x] * ((float)RED8(data[filter_idx]));
-					green += filter[filter_y][filter_x] * ((float)GREEN8(data[filter_idx]));
-					blue += filter[filter_y][filter_x] * ((float)BLUE8(data[filter_idx]));
-					alpha += filter[filter_y][filter_x] * ((float)ALPHA8(data[filter_idx]));
-				}
-			}
+int op_box_blur(uint32_t width, uint32_t height, uint32_t *data, const box_blur *blur)
+{
+	/* Every box reads the whole image before the next one writes it, so the blur works in place. */
+	return op_box_blur(width, height, data, data, blur);
+}
 
-			red = TRUNCATE_CHANNEL(red, filter_factor, filter_bias);
-			green = TRUNCATE_CHANNEL(green, filter_factor, filter_bias);
-			blue = TRUNCATE_CHANNEL(blue, filter_factor, filter_bias);
-			alpha = TRUNCATE_CHANNEL(alpha, filter_factor, filter_bias);
+/*
+ * Runs a chain of operations. Every pass processes the image in bands
+ * which fit into the cache and applies the fused point operations to
+ * each band right after it was written.
+ */
+int op_chain(uint32_t width, uint32_t height, const op_step *steps, uint32_t count, uint32_t *data, uint32_t *scratch)
+{
+	chain_pass passes[OP_CHAIN_MAX];
+	uint32_t pass_count = kernel_chain_plan(steps, count, true, passes);
 
-			out[index] = RGBA32((uint8_t)red, (uint8_t)green, (uint8_t)blue, (uint8_t)alpha);
-		}
-	}
+	if(pass_count == 0)
+		return EXIT_FAILURE;
 
-	memcpy(data, out, sizeof(uint32_t) * height * width); 
-	free(out);
+	uint32_t band_rows = kernel_chain_band_rows(width);
 
-	return EXIT_SUCCESS;
-}
\ No newline at end of file
+	return kernel_chain_run(width, height, passes, pass_count, data, scratch, band_rows, run_serial);
+}
+
+/*
+ * Runs the tasks one after another on the caller.
+ */
+uint32_t op_threads()
+{
+	return 1;
+}
+
+unsigned op_run_tasks(unsigned (*task)(void *, size_t), void *data, size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		unsigned error = task(data, i);
+
+		if(error)
+			return error;
+	}
+
+	return 0;
+}
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "shared.hpp"
+#include "planar.hpp"
+#include "simd.hpp"
+
+using namespace std;
+
+int planar_alloc(planar_image *image, uint32_t width, uint32_t height)
+{
+	uint32_t stride = (width + PLANAR_ALIGNMENT - 1) / PLANAR_ALIGNMENT * PLANAR_ALIGNMENT;
+	size_t plane_size = (size_t)stride * height;
+	void *memory = NULL;
+
+	if(posix_memalign(&memory, PLANAR_ALIGNMENT, max(plane_size * 4, (size_t)PLANAR_ALIGNMENT)) != 0)
+		return EXIT_FAILURE;
+
+	image->width = width;
+	image->height = height;
+	image->stride = stride;
+
+	for(uint32_t plane = 0; plane < 4; ++plane)
+		image->planes[plane] = (uint8_t *)memory + plane * plane_size;
+
+	return EXIT_SUCCESS;
+}
+
+void planar_free(planar_image *image)
+{
+	/* The planes share one allocation which starts with the red plane. */
+	free(image->planes[0]);
+	memset(image, 0, sizeof(planar_image));
+}
+
+void planar_unpack(const uint32_t *in, planar_image *image, uint32_t row_begin, uint32_t row_end)
+{
+	uint32_t width = image->width;
+
+	for(uint32_t row = row_begin; row < row_end; ++row)
+	{
+		const uint32_t *pixels = in + (size_t)row * width;
+		uint8_t *red = PLANAR_ROW(image, 0, row);
+		uint8_t *green = PLANAR_ROW(image, 1, row);
+		uint8_t *blue = PLANAR_ROW(image, 2, row);
+		uint8_t *alpha = PLANAR_ROW(image, 3, row);
+
+		uint32_t col = simd_level() >= SIMD_SSE41 ? simd_unpack_sse41(pixels, red, green, blue, alpha, width) : 0;
+
+		for(; col < width; ++col)
+		{
+			red[col] = RED8(pixels[col]);
+			green[col] = GREEN8(pixels[col]);
+			blue[col] = BLUE8(pixels[col]);
+			alpha[col] = ALPHA8(pixels[col]);
+		}
+	}
+}
+
+void planar_pack(const planar_image *image, uint32_t *out, uint32_t row_begin, uint32_t row_end)
+{
+	uint32_t width = image->width;
+
+	for(uint32_t row = row_begin; row < row_end; ++row)
+	{
+		uint32_t *pixels = out + (size_t)row * width;
+		const uint8_t *red = PLANAR_ROW(image, 0, row);
+		const uint8_t *green = PLANAR_ROW(image, 1, row);
+		const uint8_t *blue = PLANAR_ROW(image, 2, row);
+		const uint8_t *alpha = PLANAR_ROW(image, 3, row);
+
+		uint32_t col = simd_level() >= SIMD_SSE41 ? simd_pack_sse41(red, green, blue, alpha, pixels, width) : 0;
+
+		for(; col < width; ++col)
+			pixels[col] = RGBA32((uint32_t)red[col], (uint32_t)green[col], (uint32_t)blue[col], (uint32_t)alpha[col]);
+	}
+}
+
+static const uint32_t planar_blur_weights[5] = {1, 4, 6, 4, 1};
+
+/*
+ * Horizontal pass of the planar blur for one row of a plane.
+ * The sums are at most 16 * 255 and fit into 16 bits.
+ */
+static void planar_blur_horizontal(uint32_t width, const uint8_t *row, uint16_t *sums)
+{
+	int32_t size = (int32_t)width;
+
+	for(int32_t col = 0; col < min(size, 2); ++col)
+	{
+		uint32_t sum = 0;
+
+		for(int32_t tap = 0; tap < min(col + 3, size); ++tap)
+			sum += planar_blur_weights[tap - col + 2] * row[tap];
+
+		sums[col] = (uint16_t)sum;
+	}
+
+	/* No bounds checks in the interior, the compiler vectorizes this loop. */
+	for(int32_t col = 2; col < size - 2; ++col)
+		sums[col] = (uint16_t)(row[col - 2] + row[col + 2] + 4 * (row[col - 1] + row[col + 1]) + 6 * row[col]);
+
+	for(int32_t col = max(size - 2, 2); col < size; ++col)
+	{
+		uint32_t sum = 0;
+
+		for(int32_t tap = col - 2; tap < size; ++tap)
+			sum += planar_blur_weights[tap - col + 2] * row[tap];
+
+		sums[col] = (uint16_t)sum;
+	}
+}
+
+int planar_blur(const planar_image *in, planar_image *out, uint32_t row_begin, uint32_t row_end)
+{
+	uint32_t width = in->width;
+	int32_t last = (int32_t)in->height - 1;
+
+	if(row_begin >= row_end)
+		return EXIT_SUCCESS;
+
+	/* Rolling window of five horizontally filtered rows like in kernel_blur_separable. */
+	uint16_t *window = (uint16_t *)malloc(sizeof(uint16_t) * 5 * width);
+
+	if(window == NULL)
+		return EXIT_FAILURE;
+
+	for(uint32_t plane = 0; plane < 4; ++plane)
+	{
+		int32_t next = max((int32_t)row_begin - 2, 0);
+
+		for(int32_t row = row_begin; row < (int32_t)row_end; ++row)
+		{
+			int32_t first_tap = max(row - 2, 0);
+			int32_t last_tap = min(row + 2, last);
+
+			for(; next <= last_tap; ++next)
+				planar_blur_horizontal(width, PLANAR_ROW(in, plane, next), window + (size_t)(next % 5) * width);
+
+			uint8_t *out_row = PLANAR_ROW(out, plane, row);
+
+			if(last_tap - first_tap == 4)
+			{
+				const uint16_t *a = window + (size_t)((row - 2) % 5) * width;
+				const uint16_t *b = window + (size_t)((row - 1) % 5) * width;
+				const uint16_t *c = window + (size_t)(row % 5) * width;
+				const uint16_t *d = window + (size_t)((row + 1) % 5) * width;
+				const uint16_t *e = window + (size_t)((row + 2) % 5) * width;
+
+				/* The sum is at most 256 * 255, so 16 bit lanes are enough. */
+				for(uint32_t col = 0; col < width; ++col)
+					out_row[col] = (uint8_t)((uint16_t)(a[col] + e[col] + 4 * (b[col] + d[col]) + 6 * c[col]) >> 8);
+
+				continue;
+			}
+
+			for(uint32_t col = 0; col < width; ++col)
+			{
+				uint32_t sum = 0;
+
+				for(int32_t tap = first_tap; tap <= last_tap; ++tap)
+					sum += planar_blur_weights[tap - row + 2] * window[(size_t)(tap % 5) * width + col];
+
+				out_row[col] = (uint8_t)(sum >> 8);
+			}
+		}
+	}
+
+	free(window);
+
+	return EXIT_SUCCESS;
+}
+
+void planar_emboss(const planar_image *in, planar_image *out, uint32_t row_begin, uint32_t row_end)
+{
+	uint32_t width = in->width;
+
+	for(uint32_t row = row_begin; row < row_end; ++row)
+	{
+		uint32_t top = row > 0 ? row - 1 : 0;
+
+		const uint8_t *red = PLANAR_ROW(in, 0, row);
+		const uint8_t *green = PLANAR_ROW(in, 1, row);
+		const uint8_t *blue = PLANAR_ROW(in, 2, row);
+		const uint8_t *red_top = PLANAR_ROW(in, 0, top);
+		const uint8_t *green_top = PLANAR_ROW(in, 1, top);
+		const uint8_t *blue_top = PLANAR_ROW(in, 2, top);
+
+		uint8_t *out_red = PLANAR_ROW(out, 0, row);
+		uint8_t *out_green = PLANAR_ROW(out, 1, row);
+		uint8_t *out_blue = PLANAR_ROW(out, 2, row);
+
+		if(width > 0)
+		{
+			int32_t diff = max((int32_t)red[0] - red_top[0], max((int32_t)green[0] - green_top[0], (int32_t)blue[0] - blue_top[0]));
+			out_red[0] = out_green[0] = out_blue[0] = (uint8_t)(128 + diff);
+		}
+
+		/* Like kernel_emboss the color wraps around if the difference is below -128. */
+		for(uint32_t col = 1; col < width; ++col)
+		{
+			int32_t diff_red = (int32_t)red[col] - red_top[col - 1];
+			int32_t diff_green = (int32_t)green[col] - green_top[col - 1];
+			int32_t diff_blue = (int32_t)blue[col] - blue_top[col - 1];
+
+			uint8_t color = (uint8_t)(128 + max(diff_red, max(diff_green, diff_blue)));
+
+			out_red[col] = color;
+			out_green[col] = color;
+			out_blue[col] = color;
+		}
+
+		memcpy(PLANAR_ROW(out, 3, row), PLANAR_ROW(in, 3, row), width);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Planar image with one byte plane per channel. Convolutions on planes
+ * need no shifts to extract the channels and vectorize over 16 or 32 pixels,
+ * so chains of filters unpack the packed pixels once, filter the planes and
+ * pack the result at the end.
+ */
+struct planar_image
+{
+	uint32_t width;
+	uint32_t height;
+
+	/* Bytes per row of a plane, a multiple of PLANAR_ALIGNMENT. */
+	uint32_t stride;
+
+	/* Red, green, blue and alpha plane, each aligned to PLANAR_ALIGNMENT. */
+	uint8_t *planes[4];
+};
+
+/* Alignment of the planes and their rows in bytes. */
+#define PLANAR_ALIGNMENT 64
+
+/* Returns the row of a plane. */
+#define PLANAR_ROW(image,plane,row) ((image)->planes[plane] + (size_t)(row) * (image)->stride)
+
+/*
+ * Allocates the planes of the image. Returns EXIT_FAILURE if there is no memory.
+ */
+extern int planar_alloc(planar_image *image, uint32_t width, uint32_t height);
+
+extern void planar_free(planar_image *image);
+
+/*
+ * Splits the packed pixels of the rows into the planes.
+ */
+extern void planar_unpack(const uint32_t *in, planar_image *image, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Combines the planes of the rows into packed pixels.
+ */
+extern void planar_pack(const planar_image *image, uint32_t *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Planar version of kernel_blur_separable with the same result.
+ * Returns EXIT_FAILURE if the rolling window could not be allocated.
+ */
+extern int planar_blur(const planar_image *in, planar_image *out, uint32_t row_begin, uint32_t row_end);
+
+/*
+ * Planar version of kernel_emboss with the same result.
+ */
+extern void planar_emboss(const planar_image *in, planar_image *out, uint32_t row_begin, uint32_t row_end);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <math.h>
+#include <time.h>
 
 /*
  * Common bit operations for the rgba family.
@@ -37,4 +38,12 @@
 #endif
 
 /* Get the position of a two dimensional flat array. */
-#define ARRAY2_IDX(a,b,size) (a * size) + b
\ No newline at end of file
+#define ARRAY2_IDX(a,b,size) (a * size) + b
+
+/* Wall clock time in seconds. Unlike clock() it does not add up the time of all threads. */
+static inline double wall_clock()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
\ No newline at end of file
@@ -0,0 +1,614 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "simd.hpp"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+uint32_t simd_level()
+{
+	static uint32_t level = []
+	{
+		uint32_t detected = SIMD_NONE;
+
+#ifdef SIMD_X86
+		__builtin_cpu_init();
+
+		if(__builtin_cpu_supports("avx2"))
+			detected = SIMD_AVX2;
+		else if(__builtin_cpu_supports("sse4.1"))
+			detected = SIMD_SSE41;
+#endif
+
+		const char *env = getenv("IMG_SIMD");
+
+		if(env != NULL)
+		{
+			uint32_t limit = detected;
+
+			if(strcmp(env, "none") == 0)
+				limit = SIMD_NONE;
+			else if(strcmp(env, "sse41") == 0)
+				limit = SIMD_SSE41;
+
+			detected = limit < detected ? limit : detected;
+		}
+
+		return detected;
+	}();
+
+	return level;
+}
+
+#ifdef SIMD_X86
+
+/*
+ * The grey value is computed like in kernel_grey as
+ * (0.21 * red) + (0.72 * green) + (0.07 * blue) in double precision.
+ * Integer weights can not reproduce the rounding of the doubles,
+ * so the channels are converted to doubles in the vector registers instead.
+ */
+
+__attribute__((target("sse4.1")))
+static inline __m128i grey_sse41(__m128i red, __m128i green, __m128i blue)
+{
+	const __m128d weight_red = _mm_set1_pd(0.21);
+	const __m128d weight_green = _mm_set1_pd(0.72);
+	const __m128d weight_blue = _mm_set1_pd(0.07);
+
+	__m128d low = _mm_add_pd(
+		_mm_add_pd(
+			_mm_mul_pd(weight_red, _mm_cvtepi32_pd(red)),
+			_mm_mul_pd(weight_green, _mm_cvtepi32_pd(green))),
+		_mm_mul_pd(weight_blue, _mm_cvtepi32_pd(blue)));
+
+	__m128d high = _mm_add_pd(
+		_mm_add_pd(
+			_mm_mul_pd(weight_red, _mm_cvtepi32_pd(_mm_srli_si128(red, 8))),
+			_mm_mul_pd(weight_green, _mm_cvtepi32_pd(_mm_srli_si128(green, 8)))),
+		_mm_mul_pd(weight_blue, _mm_cvtepi32_pd(_mm_srli_si128(blue, 8))));
+
+	return _mm_unpacklo_epi64(_mm_cvttpd_epi32(low), _mm_cvttpd_epi32(high));
+}
+
+__attribute__((target("sse4.1")))
+uint32_t simd_grey_sse41(const uint32_t *in, uint32_t *out, uint32_t count)
+{
+	const __m128i channel_mask = _mm_set1_epi32(0xFF);
+	const __m128i alpha_mask = _mm_set1_epi32((int32_t)0xFF000000);
+	const __m128i replicate = _mm_set1_epi32(0x010101);
+
+	uint32_t index = 0;
+
+	for(; index + 4 <= count; index += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i *)(in + index));
+
+		__m128i red = _mm_and_si128(pixels, channel_mask);
+		__m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 8), channel_mask);
+		__m128i blue = _mm_and_si128(_mm_srli_epi32(pixels, 16), channel_mask);
+
+		/* Copy the grey value into red, green and blue and keep the alpha channel. */
+		__m128i color = _mm_mullo_epi32(grey_sse41(red, green, blue), replicate);
+
+		_mm_storeu_si128((__m128i *)(out + index), _mm_or_si128(color, _mm_and_si128(pixels, alpha_mask)));
+	}
+
+	return index;
+}
+
+__attribute__((target("avx2")))
+static inline __m128i grey_avx2(__m128i red, __m128i green, __m128i blue)
+{
+	const __m256d weight_red = _mm256_set1_pd(0.21);
+	const __m256d weight_green = _mm256_set1_pd(0.72);
+	const __m256d weight_blue = _mm256_set1_pd(0.07);
+
+	__m256d grey = _mm256_add_pd(
+		_mm256_add_pd(
+			_mm256_mul_pd(weight_red, _mm256_cvtepi32_pd(red)),
+			_mm256_mul_pd(weight_green, _mm256_cvtepi32_pd(green))),
+		_mm256_mul_pd(weight_blue, _mm256_cvtepi32_pd(blue)));
+
+	return _mm256_cvttpd_epi32(grey);
+}
+
+__attribute__((target("avx2")))
+uint32_t simd_grey_avx2(const uint32_t *in, uint32_t *out, uint32_t count)
+{
+	const __m256i channel_mask = _mm256_set1_epi32(0xFF);
+	const __m256i alpha_mask = _mm256_set1_epi32((int32_t)0xFF000000);
+	const __m256i replicate = _mm256_set1_epi32(0x010101);
+
+	uint32_t index = 0;
+
+	for(; index + 8 <= count; index += 8)
+	{
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(in + index));
+
+		__m256i red = _mm256_and_si256(pixels, channel_mask);
+		__m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), channel_mask);
+		__m256i blue = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), channel_mask);
+
+		__m128i low = grey_avx2(
+			_mm256_castsi256_si128(red),
+			_mm256_castsi256_si128(green),
+			_mm256_castsi256_si128(blue));
+
+		__m128i high = grey_avx2(
+			_mm256_extracti128_si256(red, 1),
+			_mm256_extracti128_si256(green, 1),
+			_mm256_extracti128_si256(blue, 1));
+
+		__m256i grey = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		__m256i color = _mm256_mullo_epi32(grey, replicate);
+
+		_mm256_storeu_si256((__m256i *)(out + index), _mm256_or_si256(color, _mm256_and_si256(pixels, alpha_mask)));
+	}
+
+	return index;
+}
+
+/*
+ * The emboss color is 128 plus the largest difference of the color channels
+ * to the top left neighbour. The differences are computed in 32 bit lanes and
+ * the color wraps around like the cast to uint8_t of kernel_emboss.
+ */
+
+__attribute__((target("sse4.1")))
+uint32_t simd_emboss_sse41(const uint32_t *in, const uint32_t *top_left, uint32_t *out, uint32_t count)
+{
+	const __m128i channel_mask = _mm_set1_epi32(0xFF);
+	const __m128i alpha_mask = _mm_set1_epi32((int32_t)0xFF000000);
+	const __m128i offset = _mm_set1_epi32(128);
+
+	uint32_t index = 0;
+
+	for(; index + 4 <= count; index += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i *)(in + index));
+		__m128i neighbours = _mm_loadu_si128((const __m128i *)(top_left + index));
+
+		__m128i diff_red = _mm_sub_epi32(_mm_and_si128(pixels, channel_mask), _mm_and_si128(neighbours, channel_mask));
+		__m128i diff_green = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(pixels, 8), channel_mask), _mm_and_si128(_mm_srli_epi32(neighbours, 8), channel_mask));
+		__m128i diff_blue = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(pixels, 16), channel_mask), _mm_and_si128(_mm_srli_epi32(neighbours, 16), channel_mask));
+
+		__m128i color = _mm_and_si128(_mm_add_epi32(_mm_max_epi32(diff_red, _mm_max_epi32(diff_green, diff_blue)), offset), channel_mask);
+		color = _mm_or_si128(color, _mm_or_si128(_mm_slli_epi32(color, 8), _mm_slli_epi32(color, 16)));
+
+		_mm_storeu_si128((__m128i *)(out + index), _mm_or_si128(color, _mm_and_si128(pixels, alpha_mask)));
+	}
+
+	return index;
+}
+
+__attribute__((target("avx2")))
+uint32_t simd_emboss_avx2(const uint32_t *in, const uint32_t *top_left, uint32_t *out, uint32_t count)
+{
+	const __m256i channel_mask = _mm256_set1_epi32(0xFF);
+	const __m256i alpha_mask = _mm256_set1_epi32((int32_t)0xFF000000);
+	const __m256i offset = _mm256_set1_epi32(128);
+
+	uint32_t index = 0;
+
+	for(; index + 8 <= count; index += 8)
+	{
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(in + index));
+		__m256i neighbours = _mm256_loadu_si256((const __m256i *)(top_left + index));
+
+		__m256i diff_red = _mm256_sub_epi32(_mm256_and_si256(pixels, channel_mask), _mm256_and_si256(neighbours, channel_mask));
+		__m256i diff_green = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), channel_mask), _mm256_and_si256(_mm256_srli_epi32(neighbours, 8), channel_mask));
+		__m256i diff_blue = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), channel_mask), _mm256_and_si256(_mm256_srli_epi32(neighbours, 16), channel_mask));
+
+		__m256i color = _mm256_and_si256(_mm256_add_epi32(_mm256_max_epi32(diff_red, _mm256_max_epi32(diff_green, diff_blue)), offset), channel_mask);
+		color = _mm256_or_si256(color, _mm256_or_si256(_mm256_slli_epi32(color, 8), _mm256_slli_epi32(color, 16)));
+
+		_mm256_storeu_si256((__m256i *)(out + index), _mm256_or_si256(color, _mm256_and_si256(pixels, alpha_mask)));
+	}
+
+	return index;
+}
+
+__attribute__((target("avx2")))
+uint32_t simd_lut_avx2(const uint32_t *tables, const uint32_t *in, uint32_t *out, uint32_t count)
+{
+	const __m256i channel_mask = _mm256_set1_epi32(0xFF);
+	const int *red = (const int *)tables;
+	const int *green = red + 256;
+	const int *blue = green + 256;
+	const int *alpha = blue + 256;
+
+	uint32_t index = 0;
+
+	for(; index + 8 <= count; index += 8)
+	{
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(in + index));
+
+		__m256i r = _mm256_i32gather_epi32(red, _mm256_and_si256(pixels, channel_mask), 4);
+		__m256i g = _mm256_i32gather_epi32(green, _mm256_and_si256(_mm256_srli_epi32(pixels, 8), channel_mask), 4);
+		__m256i b = _mm256_i32gather_epi32(blue, _mm256_and_si256(_mm256_srli_epi32(pixels, 16), channel_mask), 4);
+		__m256i a = _mm256_i32gather_epi32(alpha, _mm256_srli_epi32(pixels, 24), 4);
+
+		_mm256_storeu_si256((__m256i *)(out + index), _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a)));
+	}
+
+	return index;
+}
+
+/*
+ * Vector version of hsv_from_rgb and hsv_to_rgb of hsv.hpp. The branches become
+ * blends, the divisions by zero of grey pixels are masked out afterwards.
+ */
+__attribute__((target("avx2")))
+uint32_t simd_hsv_adjust_avx2(const uint32_t *in, uint32_t *out, uint32_t count, float hue_shift, float saturation, float value)
+{
+	const __m256i channel_mask = _mm256_set1_epi32(0xFF);
+	const __m256i alpha_mask = _mm256_set1_epi32((int32_t)0xFF000000);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 four = _mm256_set1_ps(4.0f);
+	const __m256 six = _mm256_set1_ps(6.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 max_value = _mm256_set1_ps(255.0f);
+	const __m256 shift = _mm256_set1_ps(hue_shift);
+	const __m256 saturation_factor = _mm256_set1_ps(saturation);
+	const __m256 value_factor = _mm256_set1_ps(value);
+
+	uint32_t index = 0;
+
+	for(; index + 8 <= count; index += 8)
+	{
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(in + index));
+
+		__m256 red = _mm256_cvtepi32_ps(_mm256_and_si256(pixels, channel_mask));
+		__m256 green = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), channel_mask));
+		__m256 blue = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), channel_mask));
+
+		__m256 cmax = _mm256_max_ps(red, _mm256_max_ps(green, blue));
+		__m256 cmin = _mm256_min_ps(red, _mm256_min_ps(green, blue));
+		__m256 diff = _mm256_sub_ps(cmax, cmin);
+
+		__m256 hue_red = _mm256_div_ps(_mm256_sub_ps(green, blue), diff);
+		hue_red = _mm256_add_ps(hue_red, _mm256_and_ps(_mm256_cmp_ps(hue_red, zero, _CMP_LT_OQ), six));
+		__m256 hue_green = _mm256_add_ps(two, _mm256_div_ps(_mm256_sub_ps(blue, red), diff));
+		__m256 hue_blue = _mm256_add_ps(four, _mm256_div_ps(_mm256_sub_ps(red, green), diff));
+
+		__m256 hue = _mm256_blendv_ps(hue_blue, hue_green, _mm256_cmp_ps(cmax, green, _CMP_EQ_OQ));
+		hue = _mm256_blendv_ps(hue, hue_red, _mm256_cmp_ps(cmax, red, _CMP_EQ_OQ));
+		hue = _mm256_and_ps(hue, _mm256_cmp_ps(diff, zero, _CMP_GT_OQ));
+
+		__m256 sat = _mm256_and_ps(_mm256_div_ps(diff, cmax), _mm256_cmp_ps(cmax, zero, _CMP_GT_OQ));
+
+		/* Adjust the hsv values. */
+		hue = _mm256_add_ps(hue, shift);
+		hue = _mm256_sub_ps(hue, _mm256_and_ps(_mm256_cmp_ps(hue, six, _CMP_GE_OQ), six));
+		sat = _mm256_min_ps(_mm256_mul_ps(sat, saturation_factor), one);
+		__m256 val = _mm256_min_ps(_mm256_mul_ps(cmax, value_factor), max_value);
+
+		__m256 sector = _mm256_floor_ps(hue);
+		__m256 fraction = _mm256_sub_ps(hue, sector);
+
+		__m256 p = _mm256_mul_ps(val, _mm256_sub_ps(one, sat));
+		__m256 q = _mm256_mul_ps(val, _mm256_sub_ps(one, _mm256_mul_ps(sat, fraction)));
+		__m256 t = _mm256_mul_ps(val, _mm256_sub_ps(one, _mm256_mul_ps(sat, _mm256_sub_ps(one, fraction))));
+
+		/* Sector 0 is the default like in hsv_to_rgb. */
+		__m256 out_red = val, out_green = t, out_blue = p;
+		__m256 mask;
+
+		mask = _mm256_cmp_ps(sector, one, _CMP_EQ_OQ);
+		out_red = _mm256_blendv_ps(out_red, q, mask);
+		out_green = _mm256_blendv_ps(out_green, val, mask);
+
+		mask = _mm256_cmp_ps(sector, two, _CMP_EQ_OQ);
+		out_red = _mm256_blendv_ps(out_red, p, mask);
+		out_green = _mm256_blendv_ps(out_green, val, mask);
+		out_blue = _mm256_blendv_ps(out_blue, t, mask);
+
+		mask = _mm256_cmp_ps(sector, _mm256_set1_ps(3.0f), _CMP_EQ_OQ);
+		out_red = _mm256_blendv_ps(out_red, p, mask);
+		out_green = _mm256_blendv_ps(out_green, q, mask);
+		out_blue = _mm256_blendv_ps(out_blue, val, mask);
+
+		mask = _mm256_cmp_ps(sector, four, _CMP_EQ_OQ);
+		out_red = _mm256_blendv_ps(out_red, t, mask);
+		out_green = _mm256_blendv_ps(out_green, p, mask);
+		out_blue = _mm256_blendv_ps(out_blue, val, mask);
+
+		mask = _mm256_cmp_ps(sector, _mm256_set1_ps(5.0f), _CMP_EQ_OQ);
+		out_green = _mm256_blendv_ps(out_green, p, mask);
+		out_blue = _mm256_blendv_ps(out_blue, q, mask);
+
+		__m256i r = _mm256_cvttps_epi32(_mm256_add_ps(out_red, half));
+		__m256i g = _mm256_cvttps_epi32(_mm256_add_ps(out_green, half));
+		__m256i b = _mm256_cvttps_epi32(_mm256_add_ps(out_blue, half));
+
+		__m256i color = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+
+		_mm256_storeu_si256((__m256i *)(out + index), _mm256_or_si256(color, _mm256_and_si256(pixels, alpha_mask)));
+	}
+
+	return index;
+}
+
+/*
+ * Reciprocals of the values 0 to 255 for the saturation 255 * diff / cmax.
+ * Every entry is the smallest float which truncates to the exact integer quotient
+ * for all possible differences, so the division needs only a multiplication.
+ */
+static const float *hsv_reciprocals()
+{
+	static float table[256];
+	static bool initialized = []
+	{
+		table[0] = 0.0f;
+
+		for(int32_t divisor = 1; divisor < 256; ++divisor)
+		{
+			float reciprocal = 1.0f / divisor;
+
+			for(int32_t diff = 0; diff <= divisor; ++diff)
+			{
+				int32_t value = 255 * diff;
+
+				/* Start over with the next float until every quotient is exact. */
+				if((int32_t)((float)value * reciprocal) != value / divisor)
+				{
+					reciprocal = nextafterf(reciprocal, 2.0f);
+					diff = -1;
+				}
+			}
+
+			table[divisor] = reciprocal;
+		}
+
+		return true;
+	}();
+
+	(void)initialized;
+	return table;
+}
+
+/*
+ * Shuffle which packs the hsv bytes of four pixels (one per 32 bit lane)
+ * into the first 12 bytes of the register.
+ */
+#define HSV_PACK_SHUFFLE 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+/*
+ * The hue of kernel_hsv divides the difference of two channels by diff.
+ * The difference is never larger than diff, so the quotient is 1 if both are equal,
+ * -1 if they are equal with a different sign and 0 otherwise. The three branches
+ * on the maximum channel are blended with masks.
+ */
+
+__attribute__((target("sse4.1")))
+static inline __m128i hsv_sse41(__m128i pixels, const float *reciprocals)
+{
+	const __m128i channel_mask = _mm_set1_epi32(0xFF);
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i red = _mm_and_si128(pixels, channel_mask);
+	__m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 8), channel_mask);
+	__m128i blue = _mm_and_si128(_mm_srli_epi32(pixels, 16), channel_mask);
+
+	__m128i cmax = _mm_max_epi32(_mm_max_epi32(red, green), blue);
+	__m128i cmin = _mm_min_epi32(_mm_min_epi32(red, green), blue);
+	__m128i diff = _mm_sub_epi32(cmax, cmin);
+
+	/* Select the branch, red wins over green and green over blue. */
+	__m128i is_red = _mm_cmpeq_epi32(cmax, red);
+	__m128i is_green = _mm_andnot_si128(is_red, _mm_cmpeq_epi32(cmax, green));
+	__m128i is_blue = _mm_andnot_si128(_mm_or_si128(is_red, is_green), _mm_cmpeq_epi32(zero, zero));
+
+	__m128i delta = _mm_blendv_epi8(_mm_blendv_epi8(_mm_sub_epi32(red, green), _mm_sub_epi32(blue, red), is_green), _mm_sub_epi32(green, blue), is_red);
+	__m128i base = _mm_or_si128(_mm_and_si128(is_green, _mm_set1_epi32(85)), _mm_and_si128(is_blue, _mm_set1_epi32(200 + 171)));
+
+	/* The masks are -1 if true, so the quotient is negative minus positive. */
+	__m128i quotient = _mm_sub_epi32(_mm_cmpeq_epi32(delta, _mm_sub_epi32(zero, diff)), _mm_cmpeq_epi32(delta, diff));
+	__m128i hue = _mm_add_epi32(base, _mm_mullo_epi32(quotient, _mm_set1_epi32(43)));
+	hue = _mm_andnot_si128(_mm_cmpeq_epi32(diff, zero), _mm_and_si128(hue, channel_mask));
+
+	/* Gather the reciprocals of cmax, SSE has no gather instruction. */
+	uint32_t divisors[4];
+	_mm_storeu_si128((__m128i *)divisors, cmax);
+
+	__m128 reciprocal = _mm_setr_ps(reciprocals[divisors[0]], reciprocals[divisors[1]], reciprocals[divisors[2]], reciprocals[divisors[3]]);
+	__m128i saturation = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_mullo_epi32(diff, _mm_set1_epi32(255))), reciprocal));
+
+	__m128i hsv = _mm_or_si128(_mm_or_si128(hue, _mm_slli_epi32(saturation, 8)), _mm_slli_epi32(cmax, 16));
+
+	return _mm_shuffle_epi8(hsv, _mm_setr_epi8(HSV_PACK_SHUFFLE));
+}
+
+/* Stores the first 12 bytes of the register. */
+__attribute__((target("sse4.1")))
+static inline void hsv_store12(uint8_t *out, __m128i packed)
+{
+	_mm_storel_epi64((__m128i *)out, packed);
+	int32_t last = _mm_extract_epi32(packed, 2);
+	memcpy(out + 8, &last, sizeof(last));
+}
+
+__attribute__((target("sse4.1")))
+uint32_t simd_hsv_sse41(const uint32_t *in, uint8_t *out, uint32_t count)
+{
+	const float *reciprocals = hsv_reciprocals();
+
+	uint32_t index = 0;
+
+	for(; index + 4 <= count; index += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i *)(in + index));
+		hsv_store12(out + index * 3, hsv_sse41(pixels, reciprocals));
+	}
+
+	return index;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hsv_avx2(__m256i pixels, const float *reciprocals)
+{
+	const __m256i channel_mask = _mm256_set1_epi32(0xFF);
+	const __m256i zero = _mm256_setzero_si256();
+
+	__m256i red = _mm256_and_si256(pixels, channel_mask);
+	__m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), channel_mask);
+	__m256i blue = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), channel_mask);
+
+	__m256i cmax = _mm256_max_epi32(_mm256_max_epi32(red, green), blue);
+	__m256i cmin = _mm256_min_epi32(_mm256_min_epi32(red, green), blue);
+	__m256i diff = _mm256_sub_epi32(cmax, cmin);
+
+	__m256i is_red = _mm256_cmpeq_epi32(cmax, red);
+	__m256i is_green = _mm256_andnot_si256(is_red, _mm256_cmpeq_epi32(cmax, green));
+	__m256i is_blue = _mm256_andnot_si256(_mm256_or_si256(is_red, is_green), _mm256_cmpeq_epi32(zero, zero));
+
+	__m256i delta = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_sub_epi32(red, green), _mm256_sub_epi32(blue, red), is_green), _mm256_sub_epi32(green, blue), is_red);
+	__m256i base = _mm256_or_si256(_mm256_and_si256(is_green, _mm256_set1_epi32(85)), _mm256_and_si256(is_blue, _mm256_set1_epi32(200 + 171)));
+
+	__m256i quotient = _mm256_sub_epi32(_mm256_cmpeq_epi32(delta, _mm256_sub_epi32(zero, diff)), _mm256_cmpeq_epi32(delta, diff));
+	__m256i hue = _mm256_add_epi32(base, _mm256_mullo_epi32(quotient, _mm256_set1_epi32(43)));
+	hue = _mm256_andnot_si256(_mm256_cmpeq_epi32(diff, zero), _mm256_and_si256(hue, channel_mask));
+
+	__m256 reciprocal = _mm256_i32gather_ps(reciprocals, cmax, 4);
+	__m256i saturation = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_mullo_epi32(diff, _mm256_set1_epi32(255))), reciprocal));
+
+	__m256i hsv = _mm256_or_si256(_mm256_or_si256(hue, _mm256_slli_epi32(saturation, 8)), _mm256_slli_epi32(cmax, 16));
+
+	return _mm256_shuffle_epi8(hsv, _mm256_setr_epi8(HSV_PACK_SHUFFLE, HSV_PACK_SHUFFLE));
+}
+
+__attribute__((target("avx2")))
+uint32_t simd_hsv_avx2(const uint32_t *in, uint8_t *out, uint32_t count)
+{
+	const float *reciprocals = hsv_reciprocals();
+
+	uint32_t index = 0;
+
+	for(; index + 8 <= count; index += 8)
+	{
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(in + index));
+		__m256i packed = hsv_avx2(pixels, reciprocals);
+
+		/* Every 128 bit lane holds the 12 bytes of four pixels. */
+		hsv_store12(out + index * 3, _mm256_castsi256_si128(packed));
+		hsv_store12(out + index * 3 + 12, _mm256_extracti128_si256(packed, 1));
+	}
+
+	return index;
+}
+
+__attribute__((target("sse4.1")))
+uint32_t simd_unpack_sse41(const uint32_t *in, uint8_t *red, uint8_t *green, uint8_t *blue, uint8_t *alpha, uint32_t count)
+{
+	/* Groups the bytes of four pixels by channel. */
+	const __m128i group = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+	uint32_t index = 0;
+
+	for(; index + 16 <= count; index += 16)
+	{
+		__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + index)), group);
+		__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + index + 4)), group);
+		__m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + index + 8)), group);
+		__m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + index + 12)), group);
+
+		/* Transposes the 4x4 matrix of channel groups. */
+		__m128i ab_low = _mm_unpacklo_epi32(a, b);
+		__m128i ab_high = _mm_unpackhi_epi32(a, b);
+		__m128i cd_low = _mm_unpacklo_epi32(c, d);
+		__m128i cd_high = _mm_unpackhi_epi32(c, d);
+
+		_mm_storeu_si128((__m128i *)(red + index), _mm_unpacklo_epi64(ab_low, cd_low));
+		_mm_storeu_si128((__m128i *)(green + index), _mm_unpackhi_epi64(ab_low, cd_low));
+		_mm_storeu_si128((__m128i *)(blue + index), _mm_unpacklo_epi64(ab_high, cd_high));
+		_mm_storeu_si128((__m128i *)(alpha + index), _mm_unpackhi_epi64(ab_high, cd_high));
+	}
+
+	return index;
+}
+
+__attribute__((target("sse4.1")))
+uint32_t simd_pack_sse41(const uint8_t *red, const uint8_t *green, const uint8_t *blue, const uint8_t *alpha, uint32_t *out, uint32_t count)
+{
+	uint32_t index = 0;
+
+	for(; index + 16 <= count; index += 16)
+	{
+		__m128i r = _mm_loadu_si128((const __m128i *)(red + index));
+		__m128i g = _mm_loadu_si128((const __m128i *)(green + index));
+		__m128i b = _mm_loadu_si128((const __m128i *)(blue + index));
+		__m128i a = _mm_loadu_si128((const __m128i *)(alpha + index));
+
+		__m128i rg_low = _mm_unpacklo_epi8(r, g);
+		__m128i rg_high = _mm_unpackhi_epi8(r, g);
+		__m128i ba_low = _mm_unpacklo_epi8(b, a);
+		__m128i ba_high = _mm_unpackhi_epi8(b, a);
+
+		_mm_storeu_si128((__m128i *)(out + index), _mm_unpacklo_epi16(rg_low, ba_low));
+		_mm_storeu_si128((__m128i *)(out + index + 4), _mm_unpackhi_epi16(rg_low, ba_low));
+		_mm_storeu_si128((__m128i *)(out + index + 8), _mm_unpacklo_epi16(rg_high, ba_high));
+		_mm_storeu_si128((__m128i *)(out + index + 12), _mm_unpackhi_epi16(rg_high, ba_high));
+	}
+
+	return index;
+}
+
+#else
+
+uint32_t simd_grey_sse41(const uint32_t *in, uint32_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_grey_avx2(const uint32_t *in, uint32_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_emboss_sse41(const uint32_t *in, const uint32_t *top_left, uint32_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_emboss_avx2(const uint32_t *in, const uint32_t *top_left, uint32_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_lut_avx2(const uint32_t *tables, const uint32_t *in, uint32_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_hsv_adjust_avx2(const uint32_t *in, uint32_t *out, uint32_t count, float hue_shift, float saturation, float value)
+{
+	return 0;
+}
+
+uint32_t simd_hsv_sse41(const uint32_t *in, uint8_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_hsv_avx2(const uint32_t *in, uint8_t *out, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_unpack_sse41(const uint32_t *in, uint8_t *red, uint8_t *green, uint8_t *blue, uint8_t *alpha, uint32_t count)
+{
+	return 0;
+}
+
+uint32_t simd_pack_sse41(const uint8_t *red, const uint8_t *green, const uint8_t *blue, const uint8_t *alpha, uint32_t *out, uint32_t count)
+{
+	return 0;
+}
+
+#endif
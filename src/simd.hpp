@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Vectorized versions of the CPU kernels for x86.
+ * The kernels are compiled for their instruction set with target attributes,
+ * so the binaries run on every x86 machine and pick them at runtime.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SIMD_X86 1
+#endif
+
+/* Instruction sets detected at runtime. */
+#define SIMD_NONE 0
+#define SIMD_SSE41 1
+#define SIMD_AVX2 2
+
+/*
+ * Returns the best instruction set of the cpu.
+ * Can be lowered with the environment variable IMG_SIMD (none, sse41 or avx2).
+ */
+extern uint32_t simd_level();
+
+/*
+ * Greyscales up to count pixels with the same double arithmetic as kernel_grey.
+ * Returns the number of processed pixels, the remaining ones are left to the caller.
+ * The input may be the output buffer.
+ */
+extern uint32_t simd_grey_sse41(const uint32_t *in, uint32_t *out, uint32_t count);
+extern uint32_t simd_grey_avx2(const uint32_t *in, uint32_t *out, uint32_t count);
+
+/*
+ * Converts up to count pixels to hsv like kernel_hsv and writes three bytes per pixel.
+ * Returns the number of processed pixels, the remaining ones are left to the caller.
+ * The output may be the input buffer because every store lies behind the loaded pixels.
+ */
+extern uint32_t simd_hsv_sse41(const uint32_t *in, uint8_t *out, uint32_t count);
+extern uint32_t simd_hsv_avx2(const uint32_t *in, uint8_t *out, uint32_t count);
+
+/*
+ * Embosses up to count pixels like kernel_emboss, the top left neighbour of
+ * the pixel in[i] is top_left[i]. Returns the number of processed pixels.
+ * The output may be the input buffer but must not overlap the neighbours.
+ */
+extern uint32_t simd_emboss_sse41(const uint32_t *in, const uint32_t *top_left, uint32_t *out, uint32_t count);
+extern uint32_t simd_emboss_avx2(const uint32_t *in, const uint32_t *top_left, uint32_t *out, uint32_t count);
+
+/*
+ * Looks up the channels of up to count pixels in the tables of kernel_lut,
+ * which hold the new channel values already shifted to their position.
+ * Only AVX2 has gather instructions. Returns the number of processed pixels.
+ * The input may be the output buffer.
+ */
+extern uint32_t simd_lut_avx2(const uint32_t *tables, const uint32_t *in, uint32_t *out, uint32_t count);
+
+/*
+ * Adjusts up to count pixels like kernel_hsv_adjust with the same float arithmetic,
+ * the hue shift is given in sectors [0, 6). Returns the number of processed pixels.
+ * The input may be the output buffer.
+ */
+extern uint32_t simd_hsv_adjust_avx2(const uint32_t *in, uint32_t *out, uint32_t count, float hue_shift, float saturation, float value);
+
+/*
+ * Splits up to count pixels into one byte per channel and back for planar images.
+ * Return the number of processed pixels, the remaining ones are left to the caller.
+ */
+extern uint32_t simd_unpack_sse41(const uint32_t *in, uint8_t *red, uint8_t *green, uint8_t *blue, uint8_t *alpha, uint32_t count);
+extern uint32_t simd_pack_sse41(const uint8_t *red, const uint8_t *green, const uint8_t *blue, const uint8_t *alpha, uint32_t *out, uint32_t count);
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include "thread_pool.hpp"
+
+using namespace std;
+
+thread_pool::thread_pool(uint32_t threads)
+	: job_next(0)
+{
+	if(threads == 0)
+	{
+		const char *env = getenv("IMG_THREADS");
+
+		if(env != nullptr)
+			threads = (uint32_t)max(atoi(env), 0);
+
+		if(threads == 0)
+			threads = max(thread::hardware_concurrency(), 1u);
+	}
+
+	for(uint32_t i = 1; i < threads; ++i)
+		workers.emplace_back(&thread_pool::work, this);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for(thread &worker : workers)
+		worker.join();
+}
+
+void thread_pool::parallel_for(uint32_t count, uint32_t grain, const task &fn)
+{
+	if(count == 0)
+		return;
+
+	grain = max(grain, 1u);
+
+	/* Small jobs are not worth waking up the workers. */
+	if(workers.empty() || count <= grain)
+	{
+		fn(0, count);
+		return;
+	}
+
+	/* The workers are busy with the job of another thread, e.g. a batch worker. */
+	unique_lock<std::mutex> job_lock(job_mutex, try_to_lock);
+
+	if(!job_lock.owns_lock())
+	{
+		for(uint32_t begin = 0; begin < count; begin += grain)
+			fn(begin, min(begin + grain, count));
+
+		return;
+	}
+
+	{
+		lock_guard<std::mutex> lock(mutex);
+		job_fn = &fn;
+		job_count = count;
+		job_grain = grain;
+		job_next = 0;
+		job_active = (uint32_t)workers.size();
+		++job_generation;
+	}
+
+	wake.notify_all();
+	run_chunks();
+
+	/* Wait until every worker has left the job before releasing fn. */
+	unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return job_active == 0; });
+	job_fn = nullptr;
+}
+
+void thread_pool::run_chunks()
+{
+	for(;;)
+	{
+		uint32_t begin = job_next.fetch_add(job_grain);
+
+		if(begin >= job_count)
+			break;
+
+		(*job_fn)(begin, min(begin + job_grain, job_count));
+	}
+}
+
+void thread_pool::work()
+{
+	uint64_t seen = 0;
+
+	for(;;)
+	{
+		{
+			unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || job_generation != seen; });
+
+			if(stopping)
+				return;
+
+			seen = job_generation;
+		}
+
+		run_chunks();
+
+		{
+			lock_guard<std::mutex> lock(mutex);
+			--job_active;
+		}
+
+		done.notify_one();
+	}
+}
+
+thread_pool& shared_thread_pool()
+{
+	static thread_pool pool;
+	return pool;
+}
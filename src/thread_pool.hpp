@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of worker threads which split a range of work items
+ * into chunks. The calling thread takes part in the work, so a pool
+ * with one thread runs everything on the caller without any locking.
+ */
+class thread_pool
+{
+public:
+	/* Callback which processes the items [begin, end). */
+	typedef std::function<void(uint32_t begin, uint32_t end)> task;
+
+	/*
+	 * Creates a pool with the given number of threads including the caller.
+	 * If threads is zero the environment variable IMG_THREADS or the
+	 * number of hardware threads is used.
+	 */
+	explicit thread_pool(uint32_t threads = 0);
+
+	~thread_pool();
+
+	/* Number of threads working on a job including the caller. */
+	uint32_t size() const { return (uint32_t)workers.size() + 1; }
+
+	/*
+	 * Runs the task on chunks of at most grain items until all
+	 * items in [0, count) are processed. Blocks until the job is done.
+	 * If another thread already runs a job the caller processes all chunks itself.
+	 */
+	void parallel_for(uint32_t count, uint32_t grain, const task &fn);
+
+private:
+	void work();
+	void run_chunks();
+
+	std::vector<std::thread> workers;
+	std::mutex job_mutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	/* State of the current job, guarded by mutex. */
+	const task *job_fn = nullptr;
+	uint32_t job_count = 0;
+	uint32_t job_grain = 1;
+	uint64_t job_generation = 0;
+	uint32_t job_active = 0;
+	bool stopping = false;
+
+	std::atomic<uint32_t> job_next;
+};
+
+/*
+ * Returns the pool shared by all operations of a backend.
+ */
+extern thread_pool& shared_thread_pool();
@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "shared.hpp"
+#include "kernels.hpp"
+#include "convolution.hpp"
+#include "box_blur.hpp"
+#include "thread_pool.hpp"
+
+/* Number of rows one thread processes at once. */
+#define ROWS_PER_TASK 16
+
+/* The separable blur recomputes four rows per band, so it works on larger bands. */
+#define BLUR_ROWS_PER_TASK 64
+
+using namespace std;
+
+/*
+ * Splits the rows of the image into bands and runs the kernel on all threads.
+ */
+template<typename Kernel>
+static void run_rows(uint32_t height, Kernel kernel)
+{
+	shared_thread_pool().parallel_for(height, ROWS_PER_TASK, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel(row_begin, row_end);
+	});
+}
+
+/*
+ * Runs the ranges of a task on all threads.
+ */
+static int run_parallel(uint32_t count, uint32_t grain, const range_task &task)
+{
+	atomic<int> success(EXIT_SUCCESS);
+
+	shared_thread_pool().parallel_for(count, grain, [&](uint32_t begin, uint32_t end)
+	{
+		if(task(begin, end) != EXIT_SUCCESS)
+			success = EXIT_FAILURE;
+	});
+
+	return success;
+}
+
+/*
+ * Runs an out of place operation on a scratch image and copies the result back.
+ * Threads can not work in place because the bands read the rows of their neighbours.
+ */
+static int run_in_place(uint32_t width, uint32_t height, uint32_t *data, int (*op)(uint32_t, uint32_t, const uint32_t *, uint32_t *))
+{
+	uint32_t *out = (uint32_t *)malloc(sizeof(uint32_t) * height * width);
+
+	if(out == NULL)
+		return EXIT_FAILURE;
+
+	int success = op(width, height, data, out);
+
+	if(success == EXIT_SUCCESS)
+		memcpy(data, out, sizeof(uint32_t) * height * width);
+
+	free(out);
+
+	return success;
+}
+
+/*
+ * Greyscales the colors of the image.
+ */
+int op_grey(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	run_rows(height, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_grey(width, height, in, out, row_begin, row_end);
+	});
+
+	return EXIT_SUCCESS;
+}
+
+int op_grey(uint32_t width, uint32_t height, uint32_t *data)
+{
+	/* Every pixel only depends on itself, so the bands can work in place. */
+	return op_grey(width, height, data, data);
+}
+
+/*
+ * Replaces the channels of the image with the values of the lookup tables.
+ */
+int op_lut(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const point_lut *lut)
+{
+	run_rows(height, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_lut(width, height, lut, in, out, row_begin, row_end);
+	});
+
+	return EXIT_SUCCESS;
+}
+
+int op_lut(uint32_t width, uint32_t height, uint32_t *data, const point_lut *lut)
+{
+	return op_lut(width, height, data, data, lut);
+}
+
+/*
+ * Rotates the hue and scales the saturation and the value of the image.
+ */
+int op_hsv_adjust(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const hsv_adjust *adjust)
+{
+	run_rows(height, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_hsv_adjust(width, height, adjust, in, out, row_begin, row_end);
+	});
+
+	return EXIT_SUCCESS;
+}
+
+int op_hsv_adjust(uint32_t width, uint32_t height, uint32_t *data, const hsv_adjust *adjust)
+{
+	return op_hsv_adjust(width, height, data, data, adjust);
+}
+
+/*
+ * Converts the colorspace from rgba to hsv.
+ */
+int op_hsv(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	run_rows(height, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_hsv(width, height, in, (uint8_t *)out, row_begin, row_end);
+	});
+
+	return EXIT_SUCCESS;
+}
+
+int op_hsv(uint32_t width, uint32_t height, uint32_t *data)
+{
+	size_t size = (size_t)height * width * 3;
+	uint8_t *out = (uint8_t *)malloc(size);
+
+	if(out == NULL)
+		return EXIT_FAILURE;
+
+	run_rows(height, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_hsv(width, height, data, out, row_begin, row_end);
+	});
+
+	/* Only the three byte pixels are copied, the rest of the buffer stays untouched. */
+	memcpy(data, out, size);
+	free(out);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Applies a emboss filter to the image.
+ */
+int op_emboss(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	run_rows(height, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_emboss(width, height, in, out, row_begin, row_end);
+	});
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Applies a emboss filter in place. Every band embosses its rows bottom up and
+ * only needs a copy of the row above it, so no scratch image is needed.
+ */
+int op_emboss(uint32_t width, uint32_t height, uint32_t *data)
+{
+	uint32_t bands = (height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+	uint32_t *tops = (uint32_t *)malloc(sizeof(uint32_t) * bands * width);
+
+	if(tops == NULL)
+		return EXIT_FAILURE;
+
+	for(uint32_t band = 0; band < bands; ++band)
+	{
+		uint32_t top = band > 0 ? band * ROWS_PER_TASK - 1 : 0;
+		memcpy(tops + (size_t)band * width, data + (size_t)top * width, sizeof(uint32_t) * width);
+	}
+
+	shared_thread_pool().parallel_for(height, ROWS_PER_TASK, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		kernel_emboss_in_place(width, data, tops + (size_t)(row_begin / ROWS_PER_TASK) * width, row_begin, row_end);
+	});
+
+	free(tops);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Applies a gaussian blur filter to the image.
+ * Every band runs the separable blur and recomputes the horizontal pass
+ * of the two rows above and below it, so the bands are larger than usual.
+ */
+int op_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out)
+{
+	atomic<int> success(EXIT_SUCCESS);
+
+	int (*kernel)(uint32_t, uint32_t, const uint32_t *, uint32_t *, uint32_t, uint32_t) =
+		kernel_blur_precision() == BLUR_PRECISION_INTEGER ? kernel_blur_separable_integer : kernel_blur_separable;
+
+	shared_thread_pool().parallel_for(height, BLUR_ROWS_PER_TASK, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		if(kernel(width, height, in, out, row_begin, row_end) != EXIT_SUCCESS)
+			success = EXIT_FAILURE;
+	});
+
+	return success;
+}
+
+int op_blur(uint32_t width, uint32_t height, uint32_t *data)
+{
+	return run_in_place(width, height, data, op_blur);
+}
+
+/*
+ * Convolves the image with the filter (see convolution.hpp).
+ * Separable filters recompute the horizontal pass of the rows around a band
+ * like the blur, so the bands have the size of the blur bands.
+ */
+int op_convolve(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const convolution_filter *filter)
+{
+	atomic<int> success(EXIT_SUCCESS);
+
+	shared_thread_pool().parallel_for(height, BLUR_ROWS_PER_TASK, [&](uint32_t row_begin, uint32_t row_end)
+	{
+		if(kernel_convolve(width, height, filter, in, out, row_begin, row_end) != EXIT_SUCCESS)
+			success = EXIT_FAILURE;
+	});
+
+	return success;
+}
+
+int op_convolve(uint32_t width, uint32_t height, uint32_t *data, const convolution_filter *filter)
+{
+	uint32_t *out = (uint32_t *)malloc(sizeof(uint32_t) * height * width);
+
+	if(out == NULL)
+		return EXIT_FAILURE;
+
+	int success = op_convolve(width, height, data, out, filter);
+
+	if(success == EXIT_SUCCESS)
+		memcpy(data, out, sizeof(uint32_t) * height * width);
+
+	free(out);
+
+	return success;
+}
+
+/*
+ * Applies a box blur to the image (see box_blur.hpp).
+ * The horizontal boxes run on bands of rows and the vertical boxes on strips of columns.
+ */
+int op_box_blur(uint32_t width, uint32_t height, const uint32_t *in, uint32_t *out, const box_blur *blur)
+{
+	uint32_t *scratch = (uint32_t *)malloc(sizeof(uint32_t) * height * width);
+
+	if(scratch == NULL)
+		return EXIT_FAILURE;
+
+	int success = kernel_box_blur(width, height, blur, in, out, scratch, run_parallel);
+	free(scratch);
+
+	return success;
+}
+
+int op_box_blur(uint32_t width, uint32_t height, uint32_t *data, const box_blur *blur)
+{
+	return op_box_blur(width, height, data, data, blur);
+}
+
+/*
+ * Runs a chain of operations. The bands of a pass run on all threads
+ * and every band applies the fused greyscale right after it was written.
+ * Hsv moves the pixels of earlier bands, so it runs as a pass of its own.
+ */
+int op_chain(uint32_t width, uint32_t height, const op_step *steps, uint32_t count, uint32_t *data, uint32_t *scratch)
+{
+	chain_pass passes[OP_CHAIN_MAX];
+	uint32_t pass_count = kernel_chain_plan(steps, count, false, passes);
+
+	if(pass_count == 0)
+		return EXIT_FAILURE;
+
+	uint32_t band_rows = max(kernel_chain_band_rows(width), (uint32_t)BLUR_ROWS_PER_TASK);
+
+	return kernel_chain_run(width, height, passes, pass_count, data, scratch, band_rows, run_parallel);
+}
+
+uint32_t op_threads()
+{
+	return shared_thread_pool().size();
+}
+
+/*
+ * Runs every task as a chunk of its own on the pool, a busy pool
+ * runs them on the caller. Returns the first error of a task.
+ */
+unsigned op_run_tasks(unsigned (*task)(void *, size_t), void *data, size_t count)
+{
+	atomic<unsigned> error(0);
+
+	for(size_t first = 0; first < count && error == 0; first += UINT32_MAX)
+	{
+		uint32_t chunk = (uint32_t)min<size_t>(count - first, UINT32_MAX);
+
+		shared_thread_pool().parallel_for(chunk, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for(uint32_t i = begin; i < end && error == 0; ++i)
+			{
+				unsigned result = task(data, first + i);
+				unsigned none = 0;
+
+				if(result)
+					error.compare_exchange_strong(none, result);
+			}
+		});
+	}
+
+	return error;
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Checks that the integer blur produces the same images as the float blur.
+
+make no_parallism_lodepng
+mkdir -p export/
+
+failed=0
+
+for file in examples/*.png; do
+	name=$(basename "$file" .png)
+
+	IMG_BLUR_PRECISION=float bin/image_modifier_no_parallism blur "$file" "export/${name}_blur_float.png" > /dev/null
+	IMG_BLUR_PRECISION=integer bin/image_modifier_no_parallism blur "$file" "export/${name}_blur_integer.png" > /dev/null
+
+	if cmp -s "export/${name}_blur_float.png" "export/${name}_blur_integer.png"; then
+		echo "PASS $file"
+	else
+		echo "FAIL $file"
+		failed=1
+	fi
+done
+
+exit $failed
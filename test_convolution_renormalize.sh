@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Checks that filters whose weights sum to 0 are not scaled by the renormalize border mode,
+# so the result is the same as with the skip border mode.
+
+make no_parallism_lodepng
+mkdir -p export/
+
+failed=0
+filter="-1 -1 -1;-1 8 -1;-1 -1 -1"
+
+for file in examples/*.png; do
+	name=$(basename "$file" .png)
+
+	bin/image_modifier_no_parallism "convolve:$filter border=skip" "$file" "export/${name}_edge_skip.png" > /dev/null
+	bin/image_modifier_no_parallism "convolve:$filter border=renormalize" "$file" "export/${name}_edge_renormalize.png" > /dev/null
+
+	if cmp -s "export/${name}_edge_skip.png" "export/${name}_edge_renormalize.png"; then
+		echo "PASS $file"
+	else
+		echo "FAIL $file"
+		failed=1
+	fi
+done
+
+exit $failed
@@ -0,0 +1,21 @@
+#!/bin/bash
+
+# Checks that operations with invalid numbers are rejected while parsing the command line.
+
+make no_parallism_lodepng
+mkdir -p export/
+
+failed=0
+
+for operation in "gamma:nan" "gamma:inf" "brightness:nan" "contrast:inf" "contrast:-inf" "threshold:nan" "gamma:1/0" "gamma:1e30/1e-30" \
+	"gaussian:inf" "gaussian:1e10" "box:nan" "convolve:1 nan 1" "convolve:1 2 1 factor=inf" \
+	"hue:nan" "hue:inf" "saturation:nan" "value:inf" "hsv:nan:1:1" "hsv:0:inf:1"; do
+	if bin/image_modifier_no_parallism "$operation" examples/example_image2_small.png export/parse_error.png | grep -q "is not available"; then
+		echo "PASS $operation"
+	else
+		echo "FAIL $operation"
+		failed=1
+	fi
+done
+
+exit $failed